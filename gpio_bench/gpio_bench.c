@@ -0,0 +1,452 @@
+/*
+ * Throughput and latency benchmark for the bone_gpios sysfs interface.
+ *
+ * Every result is printed as one JSON object per line (or one CSV row with
+ * --csv) so runs can be collected and compared by scripts.
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../gpio_sysfs/bone_gpio_state.h"
+
+#define MAX_LINES 128
+
+static const char *class_dir = "/sys/class/bone_gpios";
+static const char *sim_dir;
+static long iterations = 100000;
+static long edge_iterations = 1000;
+static int csv;
+
+static char *lines[MAX_LINES];
+static int nr_lines;
+
+struct stats {
+  const char *bench;
+  const char *line;
+  long ops;
+  double seconds;
+  uint64_t *lat_ns;
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void die(const char *what, const char *path) {
+  fprintf(stderr, "gpio_bench: %s %s: %s\n", what, path ? path : "",
+          strerror(errno));
+  exit(1);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static void report(struct stats *st) {
+  uint64_t sum = 0, p50 = 0, p99 = 0, min = 0, max = 0;
+  double rate = st->seconds > 0 ? st->ops / st->seconds : 0;
+  long i;
+
+  if (st->lat_ns && st->ops) {
+    qsort(st->lat_ns, st->ops, sizeof(*st->lat_ns), cmp_u64);
+    for (i = 0; i < st->ops; i++) {
+      sum += st->lat_ns[i];
+    }
+    min = st->lat_ns[0];
+    max = st->lat_ns[st->ops - 1];
+    p50 = st->lat_ns[st->ops / 2];
+    p99 = st->lat_ns[(st->ops * 99) / 100];
+  }
+
+  if (csv) {
+    printf("%s,%s,%ld,%.6f,%.1f,%llu,%llu,%llu,%llu,%llu\n", st->bench,
+           st->line, st->ops, st->seconds, rate, (unsigned long long)min,
+           (unsigned long long)(st->ops ? sum / st->ops : 0),
+           (unsigned long long)p50, (unsigned long long)p99,
+           (unsigned long long)max);
+  } else {
+    printf("{\"bench\":\"%s\",\"line\":\"%s\",\"ops\":%ld,\"seconds\":%.6f,"
+           "\"ops_per_sec\":%.1f,\"lat_ns\":{\"min\":%llu,\"avg\":%llu,"
+           "\"p50\":%llu,\"p99\":%llu,\"max\":%llu}}\n",
+           st->bench, st->line, st->ops, st->seconds, rate,
+           (unsigned long long)min,
+           (unsigned long long)(st->ops ? sum / st->ops : 0),
+           (unsigned long long)p50, (unsigned long long)p99,
+           (unsigned long long)max);
+  }
+  fflush(stdout);
+}
+
+static int open_attr(const char *line, const char *attr, int flags) {
+  char path[512];
+  int fd;
+
+  snprintf(path, sizeof(path), "%s/%s/%s", class_dir, line, attr);
+  fd = open(path, flags);
+  if (fd < 0) {
+    die("cannot open", path);
+  }
+  return fd;
+}
+
+static void write_attr(const char *line, const char *attr, const char *val) {
+  int fd = open_attr(line, attr, O_WRONLY);
+
+  if (write(fd, val, strlen(val)) < 0) {
+    die("cannot write", attr);
+  }
+  close(fd);
+}
+
+static long read_attr(const char *line, const char *attr) {
+  char val[32] = "";
+  int fd = open_attr(line, attr, O_RDONLY);
+
+  if (read(fd, val, sizeof(val) - 1) < 0) {
+    die("cannot read", attr);
+  }
+  close(fd);
+  return atol(val);
+}
+
+static uint64_t *alloc_lat(long n) {
+  uint64_t *lat = calloc(n, sizeof(*lat));
+
+  if (!lat) {
+    die("out of memory", NULL);
+  }
+  return lat;
+}
+
+/*drive one output line as fast as sysfs allows*/
+static void bench_toggle(const char *line) {
+  struct stats st = {.bench = "toggle", .line = line, .ops = iterations};
+  uint64_t start, t0;
+  int fd;
+  long i;
+
+  write_attr(line, "direction", "out");
+  fd = open_attr(line, "value", O_WRONLY);
+  st.lat_ns = alloc_lat(iterations);
+
+  start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    t0 = now_ns();
+    if (pwrite(fd, (i & 1) ? "0" : "1", 1, 0) != 1) {
+      die("toggle write failed on", line);
+    }
+    st.lat_ns[i] = now_ns() - t0;
+  }
+  st.seconds = (now_ns() - start) / 1e9;
+
+  close(fd);
+  report(&st);
+  free(st.lat_ns);
+}
+
+/*read back 'value', served from the driver cache for output lines*/
+static void bench_read(const char *line) {
+  struct stats st = {.bench = "read", .line = line, .ops = iterations};
+  uint64_t start, t0;
+  char buf[8];
+  int fd;
+  long i;
+
+  fd = open_attr(line, "value", O_RDONLY);
+  st.lat_ns = alloc_lat(iterations);
+
+  start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    t0 = now_ns();
+    if (pread(fd, buf, sizeof(buf), 0) <= 0) {
+      die("read failed on", line);
+    }
+    st.lat_ns[i] = now_ns() - t0;
+  }
+  st.seconds = (now_ns() - start) / 1e9;
+
+  close(fd);
+  report(&st);
+  free(st.lat_ns);
+}
+
+/*update every line of the group per iteration, latency is per sweep*/
+static void bench_batch(void) {
+  struct stats st = {.bench = "batch", .line = "all"};
+  int fds[MAX_LINES];
+  uint64_t start, t0;
+  long i, n = iterations / (nr_lines ? nr_lines : 1);
+  int l;
+
+  for (l = 0; l < nr_lines; l++) {
+    write_attr(lines[l], "direction", "out");
+    fds[l] = open_attr(lines[l], "value", O_WRONLY);
+  }
+  st.lat_ns = alloc_lat(n ? n : 1);
+  st.ops = n;
+
+  start = now_ns();
+  for (i = 0; i < n; i++) {
+    t0 = now_ns();
+    for (l = 0; l < nr_lines; l++) {
+      if (pwrite(fds[l], (i & 1) ? "0" : "1", 1, 0) != 1) {
+        die("batch write failed on", lines[l]);
+      }
+    }
+    st.lat_ns[i] = now_ns() - t0;
+  }
+  st.seconds = (now_ns() - start) / 1e9;
+
+  for (l = 0; l < nr_lines; l++) {
+    close(fds[l]);
+  }
+  report(&st);
+  free(st.lat_ns);
+}
+
+/*time from a gpio-sim level change until poll() on 'value' returns*/
+static void bench_edge(const char *line) {
+  struct stats st = {.bench = "edge", .line = line, .ops = edge_iterations};
+  char path[512], buf[8];
+  struct pollfd pfd;
+  const char *off;
+  uint64_t start, t0;
+  int fd, pull;
+  long i;
+
+  /*lines registered by gpio-sysfs-sim are named sim.<offset>*/
+  off = strrchr(line, '.');
+  if (!off) {
+    return;
+  }
+  snprintf(path, sizeof(path), "%s/sim_gpio%s/pull", sim_dir, off + 1);
+  pull = open(path, O_WRONLY);
+  if (pull < 0) {
+    die("cannot open", path);
+  }
+
+  write_attr(line, "direction", "in");
+  pwrite(pull, "pull-down", 9, 0);
+  fd = open_attr(line, "value", O_RDONLY);
+  st.lat_ns = alloc_lat(edge_iterations);
+
+  start = now_ns();
+  for (i = 0; i < edge_iterations; i++) {
+    /*sysfs_notify only wakes pollers that have read the attribute*/
+    pread(fd, buf, sizeof(buf), 0);
+
+    pfd.fd = fd;
+    pfd.events = POLLPRI | POLLERR;
+    t0 = now_ns();
+    if (i & 1) {
+      pwrite(pull, "pull-down", 9, 0);
+    } else {
+      pwrite(pull, "pull-up", 7, 0);
+    }
+    if (poll(&pfd, 1, 1000) <= 0) {
+      fprintf(stderr, "gpio_bench: no edge event on %s\n", line);
+      st.ops = i;
+      break;
+    }
+    st.lat_ns[i] = now_ns() - t0;
+  }
+  st.seconds = (now_ns() - start) / 1e9;
+
+  close(fd);
+  close(pull);
+  report(&st);
+  free(st.lat_ns);
+}
+
+/*load a consistent copy of the state page, the seqcount reader side*/
+static void state_snapshot(const volatile struct bone_gpio_state *state,
+                           struct bone_gpio_state *snap) {
+  uint32_t seq;
+
+  do {
+    seq = state->seq;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    snap->levels = state->levels;
+    snap->timestamp_ns = state->timestamp_ns;
+    snap->changes = state->changes;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while ((seq & 1) || seq != state->seq);
+  snap->seq = seq;
+}
+
+/*same as bench_edge, but spin on the mmap'd state page instead of poll()*/
+static void bench_edge_mmap(const char *line) {
+  struct stats st = {.bench = "edge_mmap", .line = line,
+                     .ops = edge_iterations};
+  const volatile struct bone_gpio_state *state;
+  struct bone_gpio_state snap;
+  char path[512];
+  const char *off;
+  uint64_t start, t0, bit;
+  int fd, pull;
+  long i, index;
+
+  /*the line's bit in its own group's page, not its place in lines[]*/
+  index = read_attr(line, "index");
+  off = strrchr(line, '.');
+  if (!off || index >= BONE_GPIO_STATE_MAX_LINES) {
+    return;
+  }
+  bit = 1ull << index;
+  snprintf(path, sizeof(path), "%s/sim_gpio%s/pull", sim_dir, off + 1);
+  pull = open(path, O_WRONLY);
+  if (pull < 0) {
+    die("cannot open", path);
+  }
+
+  snprintf(path, sizeof(path), "%s/%s/device/state", class_dir, line);
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    die("cannot open", path);
+  }
+  state = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+  if (state == MAP_FAILED) {
+    die("cannot map", path);
+  }
+
+  write_attr(line, "direction", "in");
+  pwrite(pull, "pull-down", 9, 0);
+  usleep(1000);
+  st.lat_ns = alloc_lat(edge_iterations);
+
+  start = now_ns();
+  for (i = 0; i < edge_iterations; i++) {
+    t0 = now_ns();
+    if (i & 1) {
+      pwrite(pull, "pull-down", 9, 0);
+    } else {
+      pwrite(pull, "pull-up", 7, 0);
+    }
+    do {
+      state_snapshot(state, &snap);
+      if (now_ns() - t0 > 1000000000ull) {
+        fprintf(stderr, "gpio_bench: no state change on %s\n", line);
+        st.ops = i;
+        goto out;
+      }
+    } while (!!(snap.levels & bit) != !(i & 1));
+    st.lat_ns[i] = now_ns() - t0;
+  }
+out:
+  st.seconds = (now_ns() - start) / 1e9;
+
+  munmap((void *)state, sysconf(_SC_PAGESIZE));
+  close(fd);
+  close(pull);
+  report(&st);
+  free(st.lat_ns);
+}
+
+static int cmp_str(const void *a, const void *b) {
+  return strverscmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void find_lines(void) {
+  struct dirent *de;
+  DIR *dir;
+
+  dir = opendir(class_dir);
+  if (!dir) {
+    die("cannot open", class_dir);
+  }
+  while ((de = readdir(dir)) && nr_lines < MAX_LINES) {
+    if (de->d_name[0] == '.') {
+      continue;
+    }
+    lines[nr_lines++] = strdup(de->d_name);
+  }
+  closedir(dir);
+  qsort(lines, nr_lines, sizeof(*lines), cmp_str);
+}
+
+static void usage(void) {
+  fprintf(stderr,
+          "usage: gpio_bench [-c class_dir] [-s gpio_sim_chip_dir] [-n iters]\n"
+          "                  [-e edge_iters] [-l line]... [--csv]\n"
+          "  -s enables the edge latency benchmark, lines must be sim.<N>\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  static const struct option opts[] = {{"csv", no_argument, NULL, 'C'},
+                                       {NULL, 0, NULL, 0}};
+  int opt, l;
+
+  while ((opt = getopt_long(argc, argv, "c:s:n:e:l:", opts, NULL)) != -1) {
+    switch (opt) {
+    case 'c':
+      class_dir = optarg;
+      break;
+    case 's':
+      sim_dir = optarg;
+      break;
+    case 'n':
+      iterations = atol(optarg);
+      break;
+    case 'e':
+      edge_iterations = atol(optarg);
+      break;
+    case 'l':
+      if (nr_lines < MAX_LINES) {
+        lines[nr_lines++] = optarg;
+      }
+      break;
+    case 'C':
+      csv = 1;
+      break;
+    default:
+      usage();
+    }
+  }
+  if (iterations <= 0 || edge_iterations <= 0) {
+    usage();
+  }
+
+  if (!nr_lines) {
+    find_lines();
+  }
+  if (!nr_lines) {
+    fprintf(stderr, "gpio_bench: no lines under %s\n", class_dir);
+    return 1;
+  }
+
+  if (csv) {
+    printf("bench,line,ops,seconds,ops_per_sec,lat_min_ns,lat_avg_ns,"
+           "lat_p50_ns,lat_p99_ns,lat_max_ns\n");
+  }
+
+  bench_toggle(lines[0]);
+  bench_read(lines[0]);
+  bench_batch();
+  if (sim_dir) {
+    for (l = 0; l < nr_lines; l++) {
+      bench_edge(lines[l]);
+    }
+    for (l = 0; l < nr_lines; l++) {
+      bench_edge_mmap(lines[l]);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,31 @@
+#!/bin/sh
+# Run gpio_bench against gpio-sysfs.ko on the host, with gpio-sim standing in
+# for the BeagleBone GPIO controllers. Needs root and a kernel with
+# CONFIG_GPIO_SIM. Results go to stdout, one JSON object per line.
+#
+#   ./run_gpio_bench.sh [nr_lines] [gpio_bench options...]
+set -e
+
+GPIO_DIR=$(dirname "$0")/../gpio_sysfs
+NR_LINES=${1:-8}
+[ $# -gt 0 ] && shift
+
+cleanup() {
+	rmmod gpio-sysfs-sim 2>/dev/null || true
+	rmmod gpio-sysfs 2>/dev/null || true
+}
+trap cleanup EXIT
+
+modprobe gpio-sim
+insmod "$GPIO_DIR/gpio-sysfs.ko"
+insmod "$GPIO_DIR/gpio-sysfs-sim.ko" nr_lines="$NR_LINES"
+
+# the group probes asynchronously, wait for its lines to show up
+for i in $(seq 50); do
+	[ -e /sys/class/bone_gpios/sim.$((NR_LINES - 1)) ] && break
+	sleep 0.1
+done
+
+SIM_DIR=$(ls -d /sys/devices/platform/gpio-sim.*.auto/gpiochip* | head -n 1)
+
+"$(dirname "$0")/gpio_bench" -s "$SIM_DIR" "$@"
@@ -0,0 +1,28 @@
+#ifndef BONE_GPIO_STATE_H
+#define BONE_GPIO_STATE_H
+
+#include <linux/types.h>
+
+/*lines beyond this index of a group are not mirrored in the state page*/
+#define BONE_GPIO_STATE_MAX_LINES 64
+
+/*
+ * Layout of the read-only 'state' page of a bone-gpio-sysfs group, found at
+ * /sys/class/bone_gpios/<line>/device/state. The kernel updates it from the
+ * edge interrupt handlers under a sequence counter: seq is odd while an
+ * update is in progress. A reader loads seq, copies the fields it needs and
+ * retries if seq was odd or has changed by the time the copy is done.
+ */
+struct bone_gpio_state {
+  __u32 seq;
+  __u32 nr_lines;
+  /*bit N is the level of line N of the group, in device tree order. A
+   * line's N is in its 'index' attribute*/
+  __u64 levels;
+  /*CLOCK_MONOTONIC time of the last level change*/
+  __u64 timestamp_ns;
+  /*number of level changes since the group was probed*/
+  __u64 changes;
+};
+
+#endif
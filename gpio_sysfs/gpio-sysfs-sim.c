@@ -0,0 +1,156 @@
+#include <linux/gpio/machine.h>
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/property.h>
+#include <linux/slab.h>
+
+#undef pr_fmt
+#define pr_fmt(fmt) "%s :" fmt, __func__
+
+/*
+ * Host stand-in for the BeagleBone device tree. It registers a gpio-sim chip
+ * and a bone-gpio-sysfs device whose child nodes point at the simulated
+ * lines, the same layout am335x-boneblack-gpiosysfs.dtsi describes on the
+ * board. Line N of the group is labelled "sim.N" and is wired to offset N of
+ * the chip, its input level is driven through the sim_gpioN/pull attribute
+ * gpio-sim creates under its gpiochip device.
+ */
+
+#define SIM_LABEL "bone-gpio-sim"
+#define SIM_MAX_LINES 64
+
+static unsigned int nr_lines = 8;
+module_param(nr_lines, uint, 0444);
+MODULE_PARM_DESC(nr_lines, "number of simulated lines (max 64)");
+
+/*gpio-sim chip, the bank name doubles as the chip label used for lookup*/
+static const struct software_node sim_chip_node = {.name = "gpio-sim-bone"};
+
+static struct property_entry sim_bank_props[3];
+
+static struct software_node sim_bank_node = {
+    .name = SIM_LABEL, .parent = &sim_chip_node, .properties = sim_bank_props};
+
+/*bone-gpio-sysfs group and one child node per line*/
+static const struct software_node bone_group_node = {.name = "bone-gpio-devs"};
+
+struct sim_line {
+  char name[16];
+  char label[16];
+  struct software_node_ref_args gpio_ref;
+  struct property_entry props[3];
+  struct software_node node;
+};
+
+static struct sim_line *sim_lines;
+static const struct software_node **sim_nodes;
+
+static struct platform_device *sim_pdev;
+static struct platform_device *bone_pdev;
+
+static int sim_register_nodes(void) {
+  struct sim_line *line;
+  int i, n = 0;
+
+  sim_lines = kcalloc(nr_lines, sizeof(*sim_lines), GFP_KERNEL);
+  sim_nodes = kcalloc(nr_lines + 4, sizeof(*sim_nodes), GFP_KERNEL);
+  if (!sim_lines || !sim_nodes) {
+    return -ENOMEM;
+  }
+
+  sim_bank_props[0] = PROPERTY_ENTRY_U32("ngpios", nr_lines);
+  sim_bank_props[1] = PROPERTY_ENTRY_STRING("gpio-sim,label", SIM_LABEL);
+
+  sim_nodes[n++] = &sim_chip_node;
+  sim_nodes[n++] = &sim_bank_node;
+  sim_nodes[n++] = &bone_group_node;
+
+  for (i = 0; i < nr_lines; i++) {
+    line = &sim_lines[i];
+    snprintf(line->name, sizeof(line->name), "gpio%d", i);
+    snprintf(line->label, sizeof(line->label), "sim.%d", i);
+
+    line->gpio_ref = SOFTWARE_NODE_REFERENCE(&sim_bank_node, i,
+                                             GPIO_ACTIVE_HIGH);
+    line->props[0] = PROPERTY_ENTRY_STRING("label", line->label);
+    line->props[1] = PROPERTY_ENTRY_REF_ARRAY_LEN("bone-gpios",
+                                                  &line->gpio_ref, 1);
+
+    line->node.name = line->name;
+    line->node.parent = &bone_group_node;
+    line->node.properties = line->props;
+    sim_nodes[n++] = &line->node;
+  }
+
+  return software_node_register_node_group(sim_nodes);
+}
+
+static struct platform_device *sim_add_device(const char *name, int id,
+                                              const struct software_node *node) {
+  struct platform_device_info pdevinfo = {
+      .name = name,
+      .id = id,
+      .fwnode = software_node_fwnode(node),
+  };
+
+  return platform_device_register_full(&pdevinfo);
+}
+
+static int __init gpio_sysfs_sim_init(void) {
+  int ret = 0;
+
+  if (!nr_lines || nr_lines > SIM_MAX_LINES) {
+    pr_err("nr_lines must be between 1 and %d\n", SIM_MAX_LINES);
+    return -EINVAL;
+  }
+
+  ret = sim_register_nodes();
+  if (ret) {
+    pr_err("cannot register software nodes\n");
+    goto free_nodes;
+  }
+
+  /*the chip has to be there before the group looks its lines up*/
+  sim_pdev = sim_add_device("gpio-sim", PLATFORM_DEVID_AUTO, &sim_chip_node);
+  if (IS_ERR(sim_pdev)) {
+    pr_err("cannot register gpio-sim device\n");
+    ret = PTR_ERR(sim_pdev);
+    goto unreg_nodes;
+  }
+
+  bone_pdev =
+      sim_add_device("bone-gpio-sysfs", PLATFORM_DEVID_NONE, &bone_group_node);
+  if (IS_ERR(bone_pdev)) {
+    pr_err("cannot register bone-gpio-sysfs device\n");
+    ret = PTR_ERR(bone_pdev);
+    goto unreg_sim;
+  }
+
+  pr_info("%u simulated lines registered\n", nr_lines);
+  return 0;
+
+unreg_sim:
+  platform_device_unregister(sim_pdev);
+unreg_nodes:
+  software_node_unregister_node_group(sim_nodes);
+free_nodes:
+  kfree(sim_nodes);
+  kfree(sim_lines);
+  return ret;
+}
+
+static void __exit gpio_sysfs_sim_exit(void) {
+  platform_device_unregister(bone_pdev);
+  platform_device_unregister(sim_pdev);
+  software_node_unregister_node_group(sim_nodes);
+  kfree(sim_nodes);
+  kfree(sim_lines);
+  pr_info("simulated lines removed\n");
+}
+
+module_init(gpio_sysfs_sim_init);
+module_exit(gpio_sysfs_sim_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Yusuf Atalay");
+MODULE_DESCRIPTION("gpio-sim backed stand-in for the bone-gpio-sysfs DT node");
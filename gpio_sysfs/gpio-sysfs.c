@@ -1,14 +1,23 @@
 #include <linux/device.h>
 #include <linux/fs.h>
 #include <linux/gpio/consumer.h>
+#include <linux/hrtimer.h>
 #include <linux/init.h>
+#include <linux/interrupt.h>
 #include <linux/io.h>
 #include <linux/kernel.h>
+#include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/of.h>
 #include <linux/of_device.h>
 #include <linux/platform_device.h>
+#include <linux/property.h>
 #include <linux/string.h>
+#include <linux/version.h>
+#include <linux/workqueue.h>
+
+#include "bone_gpio_state.h"
 
 #undef pr_fmt
 #define pr_fmt(fmt) "%s :" fmt, __func__
@@ -17,30 +26,225 @@
 struct gpiodev_private_data {
   char label[20];
   struct gpio_desc *desc;
+  /*owning group and position of the line in its state page*/
+  struct gpiodrv_private_data *group;
+  int index;
+  /*serializes attribute accesses and protects the cached line state*/
+  struct mutex lock;
+  /*cached direction (0 = out, 1 = in) and last value driven on an output*/
+  bool cache_valid;
+  int direction;
+  int out_value;
+  /*number of hardware accesses served from the cache instead*/
+  atomic_long_t cache_hits;
+  /*edge interrupt tracking the level of an input line*/
+  int irq;
+  bool irq_requested;
+  /*last stable input level, the only level readers and pollers see*/
+  int in_value;
+  struct kernfs_node *value_kn;
+  /*debounce period, filtered in hardware when the controller supports it*/
+  unsigned int debounce_us;
+  bool sw_debounce;
+  struct hrtimer debounce_timer;
+  struct work_struct debounce_work;
 };
 
-/*Driver private data structure*/
+/*Driver private data structure, one per bone-gpio-sysfs node so that groups
+ * of lines are probed, used and removed independently*/
 struct gpiodrv_private_data {
   int total_devices;
-  struct class *class_gpio;
   struct device **dev;
+  /*page user space maps to read line levels without a syscall*/
+  struct bone_gpio_state *state;
+  raw_spinlock_t state_lock;
 };
 
-struct gpiodrv_private_data gpio_drv_data;
+/*class shared by all groups, devices appear under /sys/class/bone_gpios*/
+struct class *class_gpio;
+
+/*re-read direction (and output value) from the hardware, called with lock
+ * held*/
+static int gpiodev_refresh_cache(struct gpiodev_private_data *dev_data) {
+  int dir;
+
+  dev_data->cache_valid = false;
+
+  dir = gpiod_get_direction(dev_data->desc);
+  if (dir < 0) {
+    return dir;
+  }
+
+  dev_data->direction = dir;
+  if (dir == 0) {
+    dev_data->out_value = gpiod_get_value(dev_data->desc);
+  }
+  dev_data->cache_valid = true;
+
+  return 0;
+}
+
+/*mirror the level of a line into the group state page, safe from any
+ * context*/
+static void gpiodev_publish_state(struct gpiodev_private_data *dev_data,
+                                  int level) {
+  struct gpiodrv_private_data *drv_data = dev_data->group;
+  struct bone_gpio_state *state = drv_data->state;
+  unsigned long flags;
+  u64 bit;
+
+  if (dev_data->index >= BONE_GPIO_STATE_MAX_LINES) {
+    return;
+  }
+  bit = BIT_ULL(dev_data->index);
+
+  raw_spin_lock_irqsave(&drv_data->state_lock, flags);
+  WRITE_ONCE(state->seq, state->seq + 1);
+  smp_wmb();
+  if (level) {
+    state->levels |= bit;
+  } else {
+    state->levels &= ~bit;
+  }
+  state->timestamp_ns = ktime_get_ns();
+  state->changes++;
+  smp_wmb();
+  WRITE_ONCE(state->seq, state->seq + 1);
+  raw_spin_unlock_irqrestore(&drv_data->state_lock, flags);
+}
+
+/*publish a new input level, pollers of 'value' only wake on real changes*/
+static void gpiodev_report_level(struct gpiodev_private_data *dev_data,
+                                 int level) {
+  if (level < 0) {
+    return;
+  }
+
+  if (xchg(&dev_data->in_value, level) != level) {
+    gpiodev_publish_state(dev_data, level);
+    sysfs_notify_dirent(dev_data->value_kn);
+  }
+}
+
+static void gpiodev_debounce_work(struct work_struct *work) {
+  struct gpiodev_private_data *dev_data =
+      container_of(work, struct gpiodev_private_data, debounce_work);
+
+  gpiodev_report_level(dev_data, gpiod_get_value_cansleep(dev_data->desc));
+}
+
+/*the line has been quiet for debounce_us, sample the settled level*/
+static enum hrtimer_restart gpiodev_debounce_timer(struct hrtimer *timer) {
+  struct gpiodev_private_data *dev_data =
+      container_of(timer, struct gpiodev_private_data, debounce_timer);
+
+  if (gpiod_cansleep(dev_data->desc)) {
+    schedule_work(&dev_data->debounce_work);
+  } else {
+    gpiodev_report_level(dev_data, gpiod_get_value(dev_data->desc));
+  }
+
+  return HRTIMER_NORESTART;
+}
+
+static irqreturn_t gpiodev_edge_hardirq(int irq, void *data) {
+  struct gpiodev_private_data *dev_data = data;
+
+  if (!READ_ONCE(dev_data->sw_debounce)) {
+    return IRQ_WAKE_THREAD;
+  }
+
+  /*every bounce pushes the sampling point further out*/
+  hrtimer_start(&dev_data->debounce_timer,
+                ns_to_ktime((u64)dev_data->debounce_us * NSEC_PER_USEC),
+                HRTIMER_MODE_REL);
+  return IRQ_HANDLED;
+}
+
+static irqreturn_t gpiodev_edge_thread(int irq, void *data) {
+  struct gpiodev_private_data *dev_data = data;
+
+  gpiodev_report_level(dev_data, gpiod_get_value_cansleep(dev_data->desc));
+  return IRQ_HANDLED;
+}
+
+/*program the debounce period, falling back to the software filter when the
+ * controller cannot debounce, called with lock held*/
+static void gpiodev_apply_debounce(struct gpiodev_private_data *dev_data) {
+  int ret;
+
+  WRITE_ONCE(dev_data->sw_debounce, false);
+  hrtimer_cancel(&dev_data->debounce_timer);
+  cancel_work_sync(&dev_data->debounce_work);
+
+  ret = gpiod_set_debounce(dev_data->desc, dev_data->debounce_us);
+  WRITE_ONCE(dev_data->sw_debounce, ret && dev_data->debounce_us);
+}
+
+/*start tracking an input line through its edge interrupt, called with lock
+ * held*/
+static void gpiodev_edge_enable(struct gpiodev_private_data *dev_data) {
+  int irq, ret;
+
+  if (dev_data->irq_requested) {
+    return;
+  }
+
+  gpiodev_apply_debounce(dev_data);
+  WRITE_ONCE(dev_data->in_value, gpiod_get_value_cansleep(dev_data->desc));
+  gpiodev_publish_state(dev_data, dev_data->in_value);
+
+  irq = gpiod_to_irq(dev_data->desc);
+  if (irq < 0) {
+    /*no edge interrupt, inputs are sampled on every read*/
+    return;
+  }
+
+  ret = request_threaded_irq(
+      irq, gpiodev_edge_hardirq, gpiodev_edge_thread,
+      IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING | IRQF_ONESHOT,
+      dev_data->label, dev_data);
+  if (ret) {
+    pr_warn("%s: cannot request edge interrupt\n", dev_data->label);
+    return;
+  }
+
+  dev_data->irq = irq;
+  dev_data->irq_requested = true;
+}
+
+/*stop edge tracking, the interrupt must be released before the line can be
+ * driven, called with lock held*/
+static void gpiodev_edge_disable(struct gpiodev_private_data *dev_data) {
+  if (dev_data->irq_requested) {
+    free_irq(dev_data->irq, dev_data);
+    dev_data->irq_requested = false;
+  }
+
+  WRITE_ONCE(dev_data->sw_debounce, false);
+  hrtimer_cancel(&dev_data->debounce_timer);
+  cancel_work_sync(&dev_data->debounce_work);
+}
 
 /*device attributes*/
 ssize_t direction_show(struct device *dev, struct device_attribute *attr,
                        char *buf) {
   struct gpiodev_private_data *dev_data = dev_get_drvdata(dev);
-  int dir;
+  int ret = 0;
   char *direction;
 
-  dir = gpiod_get_direction(dev_data->desc);
-  if (dir < 0) {
-    return dir;
+  mutex_lock(&dev_data->lock);
+  if (dev_data->cache_valid) {
+    atomic_long_inc(&dev_data->cache_hits);
+  } else {
+    ret = gpiodev_refresh_cache(dev_data);
   }
+  direction = dev_data->direction == 0 ? "out" : "in";
+  mutex_unlock(&dev_data->lock);
 
-  direction = dir == 0 ? "out" : "in";
+  if (ret < 0) {
+    return ret;
+  }
 
   return sprintf(buf, "%s\n", direction);
 }
@@ -49,14 +253,28 @@ ssize_t direction_store(struct device *dev, struct device_attribute *attr,
                         const char *buf, size_t count) {
   int ret = 0;
   struct gpiodev_private_data *dev_data = dev_get_drvdata(dev);
+
+  mutex_lock(&dev_data->lock);
   if (sysfs_streq(buf, "in")) {
     ret = gpiod_direction_input(dev_data->desc);
+    dev_data->direction = 1;
+    if (!ret) {
+      gpiodev_edge_enable(dev_data);
+    }
   } else if (sysfs_streq(buf, "out")) {
-
+    gpiodev_edge_disable(dev_data);
     ret = gpiod_direction_output(dev_data->desc, 0);
+    dev_data->direction = 0;
+    dev_data->out_value = 0;
+    if (!ret) {
+      gpiodev_publish_state(dev_data, 0);
+    }
   } else {
-    return -EINVAL;
+    ret = -EINVAL;
   }
+  /*on failure the line state is unknown, query the hardware next time*/
+  dev_data->cache_valid = !ret;
+  mutex_unlock(&dev_data->lock);
 
   return ret ?: count;
 }
@@ -65,7 +283,21 @@ ssize_t value_show(struct device *dev, struct device_attribute *attr,
                    char *buf) {
   struct gpiodev_private_data *dev_data = dev_get_drvdata(dev);
   int value = 0;
-  value = gpiod_get_value(dev_data->desc);
+
+  mutex_lock(&dev_data->lock);
+  /*an output line holds the value we drove last and an input with an edge
+   * interrupt holds its last stable level, other inputs must be sampled*/
+  if (dev_data->cache_valid && dev_data->direction == 0) {
+    value = dev_data->out_value;
+    atomic_long_inc(&dev_data->cache_hits);
+  } else if (dev_data->irq_requested) {
+    value = READ_ONCE(dev_data->in_value);
+    atomic_long_inc(&dev_data->cache_hits);
+  } else {
+    value = gpiod_get_value(dev_data->desc);
+  }
+  mutex_unlock(&dev_data->lock);
+
   return sprintf(buf, "%d\n", value);
 }
 
@@ -80,7 +312,68 @@ ssize_t value_store(struct device *dev, struct device_attribute *attr,
     return ret;
   }
 
-  gpiod_set_value(dev_data->desc, value);
+  mutex_lock(&dev_data->lock);
+  if (!dev_data->cache_valid) {
+    ret = gpiodev_refresh_cache(dev_data);
+  }
+  /*an input ignores the value, its level comes from the pin*/
+  if (!ret && dev_data->direction != 0) {
+    ret = -EPERM;
+  }
+  if (!ret) {
+    gpiod_set_value(dev_data->desc, value);
+    if (dev_data->out_value != !!value) {
+      dev_data->out_value = !!value;
+      gpiodev_publish_state(dev_data, dev_data->out_value);
+    }
+  }
+  mutex_unlock(&dev_data->lock);
+
+  return ret ?: count;
+}
+
+ssize_t refresh_store(struct device *dev, struct device_attribute *attr,
+                      const char *buf, size_t count) {
+  struct gpiodev_private_data *dev_data = dev_get_drvdata(dev);
+  int ret = 0;
+
+  mutex_lock(&dev_data->lock);
+  ret = gpiodev_refresh_cache(dev_data);
+  mutex_unlock(&dev_data->lock);
+
+  return ret ?: count;
+}
+
+ssize_t cache_hits_show(struct device *dev, struct device_attribute *attr,
+                        char *buf) {
+  struct gpiodev_private_data *dev_data = dev_get_drvdata(dev);
+  return sprintf(buf, "%ld\n", atomic_long_read(&dev_data->cache_hits));
+}
+
+ssize_t debounce_us_show(struct device *dev, struct device_attribute *attr,
+                         char *buf) {
+  struct gpiodev_private_data *dev_data = dev_get_drvdata(dev);
+  return sprintf(buf, "%u\n", dev_data->debounce_us);
+}
+
+ssize_t debounce_us_store(struct device *dev, struct device_attribute *attr,
+                          const char *buf, size_t count) {
+  struct gpiodev_private_data *dev_data = dev_get_drvdata(dev);
+  unsigned int debounce_us;
+  int ret = 0;
+
+  ret = kstrtouint(buf, 0, &debounce_us);
+  if (ret) {
+    return ret;
+  }
+
+  mutex_lock(&dev_data->lock);
+  dev_data->debounce_us = debounce_us;
+  /*outputs pick the period up once they are switched to input*/
+  if (dev_data->irq_requested) {
+    gpiodev_apply_debounce(dev_data);
+  }
+  mutex_unlock(&dev_data->lock);
 
   return count;
 }
@@ -91,12 +384,28 @@ ssize_t label_show(struct device *dev, struct device_attribute *attr,
   return sprintf(buf, "%s\n", dev_data->label);
 }
 
+ssize_t index_show(struct device *dev, struct device_attribute *attr,
+                   char *buf) {
+  struct gpiodev_private_data *dev_data = dev_get_drvdata(dev);
+  return sprintf(buf, "%d\n", dev_data->index);
+}
+
 static DEVICE_ATTR_RW(direction);
 static DEVICE_ATTR_RW(value);
 static DEVICE_ATTR_RO(label);
-
-static struct attribute *gpio_attrs[] = {
-    &dev_attr_direction.attr, &dev_attr_value.attr, &dev_attr_label.attr, NULL};
+static DEVICE_ATTR_WO(refresh);
+static DEVICE_ATTR_RO(cache_hits);
+static DEVICE_ATTR_RW(debounce_us);
+static DEVICE_ATTR_RO(index);
+
+static struct attribute *gpio_attrs[] = {&dev_attr_direction.attr,
+                                        &dev_attr_value.attr,
+                                        &dev_attr_label.attr,
+                                        &dev_attr_refresh.attr,
+                                        &dev_attr_cache_hits.attr,
+                                        &dev_attr_debounce_us.attr,
+                                        &dev_attr_index.attr,
+                                        NULL};
 
 static struct attribute_group gpio_attr_group = {.attrs = gpio_attrs};
 
@@ -104,60 +413,158 @@ static const struct attribute_group *gpio_attr_groups[] = {&gpio_attr_group,
                                                            NULL};
 /*device attributes/*/
 
+/*group attributes*/
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+/*bin_attribute callbacks take a const attribute since 6.13*/
+#define GPIO_BIN_ATTR_CONST const
+#else
+#define GPIO_BIN_ATTR_CONST
+#endif
+
+ssize_t state_read(struct file *filp, struct kobject *kobj,
+                   GPIO_BIN_ATTR_CONST struct bin_attribute *attr, char *buf,
+                   loff_t off, size_t count) {
+  struct gpiodrv_private_data *drv_data = dev_get_drvdata(kobj_to_dev(kobj));
+  struct bone_gpio_state snapshot;
+  unsigned long flags;
+
+  if (off >= sizeof(snapshot)) {
+    return 0;
+  }
+  count = min_t(size_t, count, sizeof(snapshot) - off);
+
+  raw_spin_lock_irqsave(&drv_data->state_lock, flags);
+  snapshot = *drv_data->state;
+  raw_spin_unlock_irqrestore(&drv_data->state_lock, flags);
+
+  memcpy(buf, (char *)&snapshot + off, count);
+  return count;
+}
+
+int state_mmap(struct file *filp, struct kobject *kobj,
+               GPIO_BIN_ATTR_CONST struct bin_attribute *attr,
+               struct vm_area_struct *vma) {
+  struct gpiodrv_private_data *drv_data = dev_get_drvdata(kobj_to_dev(kobj));
+
+  if (vma->vm_pgoff || vma_pages(vma) != 1) {
+    return -EINVAL;
+  }
+
+  /*the page is only ever written by the kernel*/
+  if (vma->vm_flags & VM_WRITE) {
+    return -EPERM;
+  }
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+  vm_flags_clear(vma, VM_MAYWRITE);
+#else
+  vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+
+  /*the mapping holds a page reference, the page outlives a removed group*/
+  return vm_insert_page(vma, vma->vm_start, virt_to_page(drv_data->state));
+}
+
+static struct bin_attribute bin_attr_state = {
+    .attr = {.name = "state", .mode = 0444},
+    .size = PAGE_SIZE,
+/*6.13 to 6.16 carry the const read callback as read_new*/
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0) &&                          \
+    LINUX_VERSION_CODE < KERNEL_VERSION(6, 17, 0)
+    .read_new = state_read,
+#else
+    .read = state_read,
+#endif
+    .mmap = state_mmap,
+};
+/*group attributes/*/
+
+/*unregister the lines of a group, probe and remove of a group are
+ * serialized by the driver core*/
+static void gpio_sysfs_unregister_lines(struct gpiodrv_private_data *drv_data) {
+  struct gpiodev_private_data *dev_data;
+
+  while (drv_data->total_devices > 0) {
+    drv_data->total_devices--;
+    dev_data = dev_get_drvdata(drv_data->dev[drv_data->total_devices]);
+
+    mutex_lock(&dev_data->lock);
+    gpiodev_edge_disable(dev_data);
+    mutex_unlock(&dev_data->lock);
+    sysfs_put(dev_data->value_kn);
+
+    device_unregister(drv_data->dev[drv_data->total_devices]);
+  }
+}
+
 int gpio_sysfs_probe(struct platform_device *pdev) {
   const char *name;
-  int i, ret = 0;
+  int i = 0, ret = 0;
 
   struct device *dev = &pdev->dev;
-  /*parent device node*/
-  struct device_node *parent = pdev->dev.of_node;
-  /*child node will be populated from below macro*/
-  struct device_node *child = NULL;
+  /*child node will be populated from below macro, it comes from the device
+   * tree on the board and from software nodes on a host (gpio-sysfs-sim)*/
+  struct fwnode_handle *child = NULL;
 
   struct gpiodev_private_data *dev_data = {0};
+  struct gpiodrv_private_data *drv_data = {0};
+  int child_count;
 
-  gpio_drv_data.total_devices = of_get_child_count(parent);
-  if (gpio_drv_data.total_devices == 0) {
+  child_count = device_get_child_node_count(dev);
+  if (child_count == 0) {
     dev_warn(dev, "no devices found\n");
     return -EINVAL;
   }
 
-  dev_info(dev, "total devices found = %d\n", gpio_drv_data.total_devices);
+  dev_info(dev, "total devices found = %d\n", child_count);
+
+  drv_data = devm_kzalloc(dev, sizeof(*drv_data), GFP_KERNEL);
+  if (!drv_data) {
+    dev_err(dev, "not enough memory\n");
+    return -ENOMEM;
+  }
+
+  drv_data->dev =
+      devm_kcalloc(dev, child_count, sizeof(struct device *), GFP_KERNEL);
+  if (!drv_data->dev) {
+    dev_err(dev, "not enough memory\n");
+    return -ENOMEM;
+  }
 
-  gpio_drv_data.dev = devm_kzalloc(
-      dev, sizeof(struct device *) * gpio_drv_data.total_devices, GFP_KERNEL);
-  if (!gpio_drv_data.dev) {
+  drv_data->state = (struct bone_gpio_state *)devm_get_free_pages(
+      dev, GFP_KERNEL | __GFP_ZERO, 0);
+  if (!drv_data->state) {
     dev_err(dev, "not enough memory\n");
     return -ENOMEM;
   }
+  drv_data->state->nr_lines = min(child_count, BONE_GPIO_STATE_MAX_LINES);
+
+  raw_spin_lock_init(&drv_data->state_lock);
+  platform_set_drvdata(pdev, drv_data);
 
-  for_each_available_child_of_node(parent, child) {
+  device_for_each_child_node(dev, child) {
     /*obtained the child*/
     dev_data = devm_kzalloc(dev, sizeof(*dev_data), GFP_KERNEL);
     if (!dev_data) {
       dev_err(dev, "cannot allocate memory\n");
-      return -ENOMEM;
+      ret = -ENOMEM;
+      goto err;
     }
 
     /*obtain data from the child*/
-    if (of_property_read_string(child, "label", &name)) {
+    if (fwnode_property_read_string(child, "label", &name)) {
       dev_warn(dev, "missing label information\n");
       snprintf(dev_data->label, sizeof(dev_data->label), "UNKNWNGPIO%d", i);
     } else {
-      strcpy(dev_data->label, name);
+      strscpy(dev_data->label, name, sizeof(dev_data->label));
       dev_info(dev, "GPIO info = %s\n", dev_data->label);
     }
 
-#if 1
-    /*use this if kernel version is 5.4*/
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 5, 0)
     dev_data->desc = devm_fwnode_get_gpiod_from_child(
-        dev, "bone", &child->fwnode, GPIOD_ASIS, dev_data->label);
-
-#endif
-#if 0
-/*use this if kernel version >=6.4*/
-    dev_data->desc = devm_fwnode_gpiod_get(dev, &child->fwnode, "bone",
-                                           GPIOD_ASIS, dev_data->label);
+        dev, "bone", child, GPIOD_ASIS, dev_data->label);
+#else
+    dev_data->desc = devm_fwnode_gpiod_get(dev, child, "bone", GPIOD_ASIS,
+                                           dev_data->label);
 #endif
 
     if (IS_ERR(dev_data->desc)) {
@@ -165,65 +572,110 @@ int gpio_sysfs_probe(struct platform_device *pdev) {
       if (ret == -ENOENT) {
         dev_err(dev, "no gpio has been assigned to the requested function\n");
       }
-      return ret;
+      goto err;
     }
 
     /*set the GPIO direction to output*/
     ret = gpiod_direction_output(dev_data->desc, 0);
     if (ret) {
       dev_err(dev, "gpio direction set failed\n");
-      return ret;
+      goto err;
     }
 
+    /*the line state is known now, serve attribute reads from the cache*/
+    dev_data->group = drv_data;
+    dev_data->index = i;
+    mutex_init(&dev_data->lock);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+    hrtimer_setup(&dev_data->debounce_timer, gpiodev_debounce_timer,
+                  CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+#else
+    hrtimer_init(&dev_data->debounce_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    dev_data->debounce_timer.function = gpiodev_debounce_timer;
+#endif
+    INIT_WORK(&dev_data->debounce_work, gpiodev_debounce_work);
+    dev_data->direction = 0;
+    dev_data->out_value = 0;
+    dev_data->cache_valid = true;
+
     /*create devices under /sys/class/bone_gpios*/
-    gpio_drv_data.dev[i] =
-        device_create_with_groups(gpio_drv_data.class_gpio, dev, 0, dev_data,
-                                  gpio_attr_groups, dev_data->label);
-    if (IS_ERR(gpio_drv_data.dev[i])) {
+    drv_data->dev[i] = device_create_with_groups(
+        class_gpio, dev, 0, dev_data, gpio_attr_groups, dev_data->label);
+    if (IS_ERR(drv_data->dev[i])) {
       dev_err(dev, "cannot create device under /sys/");
-      ret = PTR_ERR(gpio_drv_data.dev[i]);
+      ret = PTR_ERR(drv_data->dev[i]);
+      goto err;
+    }
 
-      return ret;
+    /*edge changes are notified through it*/
+    dev_data->value_kn = sysfs_get_dirent(drv_data->dev[i]->kobj.sd, "value");
+    if (!dev_data->value_kn) {
+      dev_err(dev, "cannot find the value attribute\n");
+      device_unregister(drv_data->dev[i]);
+      ret = -ENOENT;
+      goto err;
     }
 
     i++;
+    drv_data->total_devices = i;
+  }
+
+  ret = device_create_bin_file(dev, &bin_attr_state);
+  if (ret) {
+    dev_err(dev, "cannot create state file\n");
+    goto err_lines;
   }
 
   return 0;
+
+err:
+  fwnode_handle_put(child);
+err_lines:
+  gpio_sysfs_unregister_lines(drv_data);
+  return ret;
 }
 
 int gpio_sysfs_remove(struct platform_device *pdev) {
-  int i = 0;
+  struct gpiodrv_private_data *drv_data = platform_get_drvdata(pdev);
 
-  pr_info("remove called\n");
-  for (; i < gpio_drv_data.total_devices; i++) {
-    device_unregister(gpio_drv_data.dev[i]);
-  }
+  dev_info(&pdev->dev, "remove called\n");
+
+  device_remove_bin_file(&pdev->dev, &bin_attr_state);
+  gpio_sysfs_unregister_lines(drv_data);
 
   return 0;
 }
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 11, 0)
+/*remove returns void since 6.11*/
+static void gpio_sysfs_remove_void(struct platform_device *pdev) {
+  gpio_sysfs_remove(pdev);
+}
+#define GPIO_SYSFS_REMOVE gpio_sysfs_remove_void
+#else
+#define GPIO_SYSFS_REMOVE gpio_sysfs_remove
+#endif
+
 struct of_device_id gpio_device_match[] = {
     {.compatible = "org,bone-gpio-sysfs"}, {}};
 
 struct platform_driver gpiosysfs_platform_driver = {
     .probe = gpio_sysfs_probe,
-    .remove = gpio_sysfs_remove,
+    .remove = GPIO_SYSFS_REMOVE,
     .driver = {.name = "bone-gpio-sysfs",
-               .of_match_table = of_match_ptr(gpio_device_match)}};
+               .of_match_table = of_match_ptr(gpio_device_match),
+               /*groups share nothing, let them probe in parallel*/
+               .probe_type = PROBE_PREFER_ASYNCHRONOUS}};
 
 int __init gpio_sysfs_init(void) {
-#if 0
-  /*Activate here if kernel version is >6.3*/ 
-  gpio_drv_data.class_gpio = class_create("bone_gpios");
-#endif
-#if 1
-  /*Activate here if kernel version is <6.4*/
-  gpio_drv_data.class_gpio = class_create(THIS_MODULE, "bone_gpios");
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+  class_gpio = class_create("bone_gpios");
+#else
+  class_gpio = class_create(THIS_MODULE, "bone_gpios");
 #endif
-  if (IS_ERR(gpio_drv_data.class_gpio)) {
+  if (IS_ERR(class_gpio)) {
     pr_err("cannot create class");
-    return PTR_ERR(gpio_drv_data.class_gpio);
+    return PTR_ERR(class_gpio);
   }
 
   platform_driver_register(&gpiosysfs_platform_driver);
@@ -234,7 +686,7 @@ int __init gpio_sysfs_init(void) {
 void __exit gpio_sysfs_exit(void) {
   platform_driver_unregister(&gpiosysfs_platform_driver);
 
-  class_destroy(gpio_drv_data.class_gpio);
+  class_destroy(class_gpio);
 }
 
 module_init(gpio_sysfs_init);
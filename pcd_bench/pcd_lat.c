@@ -0,0 +1,282 @@
+/*
+ * cyclictest style latency harness for driver syscalls. A SCHED_FIFO thread
+ * wakes up every interval on an absolute timer and times one pread, pwrite
+ * or "0"/"1" toggle write (for sysfs attributes such as a GPIO's value) on
+ * the given file, while optional stress threads hammer a device and churn
+ * memory at normal priority.
+ *
+ * The result is printed as one JSON object per line (or one CSV row with
+ * --csv): min, average, median, 99th, 99.99th percentile and worst case.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+enum lat_op { OP_READ, OP_WRITE, OP_TOGGLE };
+
+static const char *path = "/dev/pcdev-3";
+static const char *stress_path;
+static enum lat_op op = OP_WRITE;
+static size_t block = 64;
+static long iterations = 100000;
+static long interval_us = 1000;
+static int prio = 80;
+static int cpu = -1;
+static int nr_stress;
+static int csv;
+
+static volatile int stop;
+
+static uint64_t ts_ns(const struct timespec *ts) {
+  return (uint64_t)ts->tv_sec * 1000000000ull + ts->tv_nsec;
+}
+
+static void die(const char *what, const char *arg) {
+  fprintf(stderr, "pcd_lat: %s %s: %s\n", what, arg ? arg : "",
+          strerror(errno));
+  exit(1);
+}
+
+/*I/O on the stress device at random offsets plus memory churn, so the
+ * measured path competes for locks and caches*/
+static void *stress_fn(void *arg) {
+  unsigned int seed = (unsigned long)arg + 1;
+  size_t churn_size = 1 << 20;
+  off_t size, off;
+  char *buf, *churn;
+  int fd;
+
+  fd = open(stress_path, O_RDWR);
+  if (fd < 0) {
+    die("cannot open", stress_path);
+  }
+  size = lseek(fd, 0, SEEK_END);
+  buf = malloc(block);
+  churn = malloc(churn_size);
+  if (!buf || !churn) {
+    die("cannot allocate", NULL);
+  }
+  memset(buf, 's', block);
+
+  while (!stop) {
+    off = size > (off_t)block ? rand_r(&seed) % (size - block) : 0;
+    if (rand_r(&seed) & 1) {
+      (void)pwrite(fd, buf, block, off);
+    } else {
+      (void)pread(fd, buf, block, off);
+    }
+    memset(churn, rand_r(&seed), churn_size);
+  }
+
+  free(churn);
+  free(buf);
+  close(fd);
+  return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static uint64_t percentile(const uint64_t *sorted, long n, double p) {
+  long i = (long)(p * (n - 1) + 0.5);
+
+  return sorted[i < n ? i : n - 1];
+}
+
+static void set_rt(void) {
+  struct sched_param param = {.sched_priority = prio};
+  cpu_set_t set;
+
+  if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+    die("mlockall failed", NULL);
+  }
+  if (cpu >= 0) {
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set)) {
+      die("cannot pin to cpu", NULL);
+    }
+  }
+  if (prio && sched_setscheduler(0, SCHED_FIFO, &param)) {
+    die("cannot set SCHED_FIFO", NULL);
+  }
+}
+
+static void usage(void) {
+  fprintf(stderr,
+          "usage: pcd_lat [-p path] [-m read|write|toggle] [-b block] "
+          "[-n iterations] [-i interval_us] [-P prio] [-c cpu] "
+          "[-s stress_threads] [-S stress_path] [--csv]\n"
+          "  toggle writes \"0\" and \"1\" in turn, for sysfs attributes\n"
+          "  -P 0 runs at normal priority\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  static const struct option opts[] = {{"csv", no_argument, &csv, 1},
+                                       {NULL, 0, NULL, 0}};
+  static const char *op_names[] = {"read", "write", "toggle"};
+  struct timespec next, t0, t1;
+  pthread_t *stress;
+  uint64_t *lat, sum = 0;
+  long i, errors = 0;
+  ssize_t ret;
+  char *buf;
+  int c, fd;
+
+  while ((c = getopt_long(argc, argv, "p:m:b:n:i:P:c:s:S:", opts, NULL)) !=
+         -1) {
+    switch (c) {
+    case 0:
+      break;
+    case 'p':
+      path = optarg;
+      break;
+    case 'm':
+      if (!strcmp(optarg, "read")) {
+        op = OP_READ;
+      } else if (!strcmp(optarg, "write")) {
+        op = OP_WRITE;
+      } else if (!strcmp(optarg, "toggle")) {
+        op = OP_TOGGLE;
+      } else {
+        usage();
+      }
+      break;
+    case 'b':
+      block = strtoul(optarg, NULL, 0);
+      break;
+    case 'n':
+      iterations = atol(optarg);
+      break;
+    case 'i':
+      interval_us = atol(optarg);
+      break;
+    case 'P':
+      prio = atoi(optarg);
+      break;
+    case 'c':
+      cpu = atoi(optarg);
+      break;
+    case 's':
+      nr_stress = atoi(optarg);
+      break;
+    case 'S':
+      stress_path = optarg;
+      break;
+    default:
+      usage();
+    }
+  }
+  if (!block || iterations < 1 || interval_us < 0 || nr_stress < 0) {
+    usage();
+  }
+  if (!stress_path) {
+    /*random writes would be garbage for a sysfs attribute*/
+    if (nr_stress && (op == OP_TOGGLE)) {
+      usage();
+    }
+    stress_path = path;
+  }
+
+  fd = open(path, op == OP_READ ? O_RDONLY : O_WRONLY);
+  if (fd < 0) {
+    die("cannot open", path);
+  }
+  buf = malloc(block);
+  lat = calloc(iterations, sizeof(*lat));
+  stress = calloc(nr_stress ? nr_stress : 1, sizeof(*stress));
+  if (!buf || !lat || !stress) {
+    die("cannot allocate", NULL);
+  }
+  memset(buf, 'l', block);
+
+  for (i = 0; i < nr_stress; i++) {
+    if (pthread_create(&stress[i], NULL, stress_fn, (void *)i)) {
+      die("cannot create thread", NULL);
+    }
+  }
+
+  /*stress threads keep the normal policy, only this one goes real time*/
+  set_rt();
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  for (i = 0; i < iterations; i++) {
+    next.tv_nsec += interval_us * 1000;
+    while (next.tv_nsec >= 1000000000) {
+      next.tv_nsec -= 1000000000;
+      next.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    switch (op) {
+    case OP_READ:
+      ret = pread(fd, buf, block, 0);
+      break;
+    case OP_WRITE:
+      ret = pwrite(fd, buf, block, 0);
+      break;
+    default:
+      ret = pwrite(fd, (i & 1) ? "1" : "0", 1, 0);
+      break;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    if (ret < 0) {
+      errors++;
+    }
+    lat[i] = ts_ns(&t1) - ts_ns(&t0);
+    sum += lat[i];
+  }
+
+  stop = 1;
+  for (i = 0; i < nr_stress; i++) {
+    pthread_join(stress[i], NULL);
+  }
+  close(fd);
+
+  qsort(lat, iterations, sizeof(*lat), cmp_u64);
+  if (csv) {
+    printf("bench,op,path,block,stress,samples,min_ns,avg_ns,p50_ns,p99_ns,"
+           "p9999_ns,max_ns,errors\n");
+    printf("lat,%s,%s,%zu,%d,%ld,%llu,%llu,%llu,%llu,%llu,%llu,%ld\n",
+           op_names[op], path, block, nr_stress, iterations,
+           (unsigned long long)lat[0],
+           (unsigned long long)(sum / iterations),
+           (unsigned long long)percentile(lat, iterations, 0.5),
+           (unsigned long long)percentile(lat, iterations, 0.99),
+           (unsigned long long)percentile(lat, iterations, 0.9999),
+           (unsigned long long)lat[iterations - 1], errors);
+  } else {
+    printf("{\"bench\":\"lat\",\"op\":\"%s\",\"path\":\"%s\",\"block\":%zu,"
+           "\"stress\":%d,\"samples\":%ld,\"min_ns\":%llu,\"avg_ns\":%llu,"
+           "\"p50_ns\":%llu,\"p99_ns\":%llu,\"p9999_ns\":%llu,"
+           "\"max_ns\":%llu,\"errors\":%ld}\n",
+           op_names[op], path, block, nr_stress, iterations,
+           (unsigned long long)lat[0],
+           (unsigned long long)(sum / iterations),
+           (unsigned long long)percentile(lat, iterations, 0.5),
+           (unsigned long long)percentile(lat, iterations, 0.99),
+           (unsigned long long)percentile(lat, iterations, 0.9999),
+           (unsigned long long)lat[iterations - 1], errors);
+  }
+
+  free(stress);
+  free(lat);
+  free(buf);
+  return 0;
+}
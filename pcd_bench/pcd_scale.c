@@ -0,0 +1,209 @@
+/*
+ * Scaling benchmark for concurrent access to one pcd device. 1 to N threads
+ * pwrite (or pread) blocks at random offsets, either each inside its own
+ * region of the device (disjoint) or all over the same region (overlap).
+ *
+ * Every result is printed as one JSON object per line (or one CSV row with
+ * --csv), one per thread count.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *device = "/dev/pcdev-3";
+static int max_threads = 8;
+static size_t block = 4096;
+static long iterations = 100000;
+static int overlap;
+static int do_read;
+static int csv;
+
+static off_t dev_size;
+static pthread_barrier_t start_barrier;
+
+struct worker {
+  pthread_t thread;
+  int fd;
+  int id;
+  int nr_threads;
+  uint64_t ns;
+  long errors;
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void die(const char *what, const char *path) {
+  fprintf(stderr, "pcd_scale: %s %s: %s\n", what, path ? path : "",
+          strerror(errno));
+  exit(1);
+}
+
+static void *worker_fn(void *arg) {
+  struct worker *w = arg;
+  off_t region, base, nr_blocks, off;
+  unsigned int seed = w->id + 1;
+  uint64_t start;
+  char *buf;
+  long i;
+
+  buf = malloc(block);
+  if (!buf) {
+    die("cannot allocate", NULL);
+  }
+  memset(buf, 'a' + w->id % 26, block);
+
+  /*disjoint: thread i stays in the i-th slice of the device*/
+  region = overlap ? dev_size : dev_size / w->nr_threads;
+  base = overlap ? 0 : region * w->id;
+  nr_blocks = region / block;
+  if (!nr_blocks) {
+    nr_blocks = 1;
+  }
+
+  pthread_barrier_wait(&start_barrier);
+  start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    off = base + (rand_r(&seed) % nr_blocks) * block;
+    if ((do_read ? pread(w->fd, buf, block, off)
+                 : pwrite(w->fd, buf, block, off)) != (ssize_t)block) {
+      w->errors++;
+    }
+  }
+  w->ns = now_ns() - start;
+
+  free(buf);
+  return NULL;
+}
+
+static void run(int nr_threads) {
+  struct worker *workers = calloc(nr_threads, sizeof(*workers));
+  uint64_t max_ns = 0;
+  long errors = 0;
+  double seconds, ops, rate;
+  int i;
+
+  if (!workers) {
+    die("cannot allocate", NULL);
+  }
+
+  pthread_barrier_init(&start_barrier, NULL, nr_threads);
+  for (i = 0; i < nr_threads; i++) {
+    workers[i].id = i;
+    workers[i].nr_threads = nr_threads;
+    /*one open file per thread, like independent processes*/
+    workers[i].fd = open(device, O_RDWR);
+    if (workers[i].fd < 0) {
+      die("cannot open", device);
+    }
+    if (pthread_create(&workers[i].thread, NULL, worker_fn, &workers[i])) {
+      die("cannot create thread", NULL);
+    }
+  }
+
+  for (i = 0; i < nr_threads; i++) {
+    pthread_join(workers[i].thread, NULL);
+    close(workers[i].fd);
+    if (workers[i].ns > max_ns) {
+      max_ns = workers[i].ns;
+    }
+    errors += workers[i].errors;
+  }
+  pthread_barrier_destroy(&start_barrier);
+
+  seconds = max_ns / 1e9;
+  ops = (double)iterations * nr_threads;
+  rate = seconds > 0 ? ops / seconds : 0;
+
+  if (csv) {
+    printf("%s,%s,%d,%zu,%.0f,%.6f,%.1f,%.1f,%ld\n",
+           do_read ? "read" : "write", overlap ? "overlap" : "disjoint",
+           nr_threads, block, ops, seconds, rate, rate * block / 1e6, errors);
+  } else {
+    printf("{\"bench\":\"%s\",\"mode\":\"%s\",\"threads\":%d,\"block\":%zu,"
+           "\"ops\":%.0f,\"seconds\":%.6f,\"ops_per_sec\":%.1f,"
+           "\"mb_per_sec\":%.1f,\"errors\":%ld}\n",
+           do_read ? "read" : "write", overlap ? "overlap" : "disjoint",
+           nr_threads, block, ops, seconds, rate, rate * block / 1e6, errors);
+  }
+  fflush(stdout);
+  free(workers);
+}
+
+static void usage(void) {
+  fprintf(stderr,
+          "usage: pcd_scale [-d device] [-t max_threads] [-b block] "
+          "[-n iterations] [-o] [-r] [--csv]\n"
+          "  -o  all threads share one region instead of one region each\n"
+          "  -r  pread instead of pwrite\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  static const struct option opts[] = {{"csv", no_argument, &csv, 1},
+                                       {NULL, 0, NULL, 0}};
+  int c, fd, i;
+
+  while ((c = getopt_long(argc, argv, "d:t:b:n:or", opts, NULL)) != -1) {
+    switch (c) {
+    case 0:
+      break;
+    case 'd':
+      device = optarg;
+      break;
+    case 't':
+      max_threads = atoi(optarg);
+      break;
+    case 'b':
+      block = strtoul(optarg, NULL, 0);
+      break;
+    case 'n':
+      iterations = atol(optarg);
+      break;
+    case 'o':
+      overlap = 1;
+      break;
+    case 'r':
+      do_read = 1;
+      break;
+    default:
+      usage();
+    }
+  }
+  if (max_threads < 1 || !block || iterations < 1) {
+    usage();
+  }
+
+  fd = open(device, O_RDWR);
+  if (fd < 0) {
+    die("cannot open", device);
+  }
+  dev_size = lseek(fd, 0, SEEK_END);
+  close(fd);
+  if (dev_size < (off_t)block) {
+    fprintf(stderr, "pcd_scale: %s is smaller than one block\n", device);
+    return 1;
+  }
+
+  if (csv) {
+    printf("bench,mode,threads,block,ops,seconds,ops_per_sec,mb_per_sec,"
+           "errors\n");
+  }
+  for (i = 1; i <= max_threads; i++) {
+    run(i);
+  }
+
+  return 0;
+}
@@ -0,0 +1,371 @@
+/*
+ * Benchmark suite for all pcd variants. For every combination of operation,
+ * block size, thread count and device count it runs -n operations per
+ * thread and reports throughput and per-operation latency. Threads are
+ * spread round robin over the first devices given with -p, each with its
+ * own open file.
+ *
+ * Operations are pread, pwrite, lseek (SEEK_SET to a random offset) and
+ * open/close of the device file. Block sizes only apply to read and write.
+ *
+ * Every result is printed as one JSON object per line (or one CSV row with
+ * --csv), tagged with the -V variant name so runs can be compared over time.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_LIST 16
+
+enum suite_op { OP_READ, OP_WRITE, OP_SEEK, OP_OPENCLOSE, NR_OPS };
+
+static const char *op_names[NR_OPS] = {"read", "write", "seek", "openclose"};
+static const int op_flags[NR_OPS] = {O_RDONLY, O_WRONLY, O_RDONLY, O_RDONLY};
+
+static const char *variant = "pcd";
+static const char *paths[MAX_LIST];
+static int nr_paths;
+static long blocks[MAX_LIST] = {64, 512, 4096};
+static int nr_blocks = 3;
+static long threads[MAX_LIST] = {1, 2, 4};
+static int nr_threads = 3;
+static long devices[MAX_LIST];
+static int nr_devices;
+static int ops_enabled[NR_OPS] = {1, 1, 1, 1};
+static long iterations = 10000;
+static int csv;
+
+static pthread_barrier_t start_barrier;
+
+struct worker {
+  pthread_t thread;
+  const char *path;
+  enum suite_op op;
+  size_t block;
+  int id;
+  uint64_t *lat;
+  uint64_t start, end;
+  uint64_t bytes;
+  long errors;
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void die(const char *what, const char *path) {
+  fprintf(stderr, "pcd_suite: %s %s: %s\n", what, path ? path : "",
+          strerror(errno));
+  exit(1);
+}
+
+static void *worker_fn(void *arg) {
+  struct worker *w = arg;
+  unsigned int seed = w->id + 1;
+  off_t size, span, off;
+  uint64_t t0;
+  ssize_t ret;
+  char *buf;
+  long i;
+  int fd;
+
+  fd = open(w->path, op_flags[w->op]);
+  if (fd < 0) {
+    die("cannot open", w->path);
+  }
+  /*the stub drivers report 0, keep them at offset 0*/
+  size = lseek(fd, 0, SEEK_END);
+  span = (size > (off_t)w->block) ? size - w->block + 1 : 1;
+  buf = malloc(w->block ? w->block : 1);
+  if (!buf) {
+    die("cannot allocate", NULL);
+  }
+  memset(buf, 'a' + w->id % 26, w->block);
+
+  pthread_barrier_wait(&start_barrier);
+  w->start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    off = rand_r(&seed) % span;
+    t0 = now_ns();
+    switch (w->op) {
+    case OP_READ:
+      ret = pread(fd, buf, w->block, off);
+      break;
+    case OP_WRITE:
+      ret = pwrite(fd, buf, w->block, off);
+      break;
+    case OP_SEEK:
+      ret = lseek(fd, off, SEEK_SET);
+      ret = (ret < 0) ? ret : 0;
+      break;
+    default:
+      ret = close(open(w->path, op_flags[w->op]));
+      break;
+    }
+    w->lat[i] = now_ns() - t0;
+
+    if (ret < 0) {
+      w->errors++;
+    } else {
+      w->bytes += ret;
+    }
+  }
+  w->end = now_ns();
+
+  free(buf);
+  close(fd);
+  return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static uint64_t percentile(const uint64_t *sorted, long n, double p) {
+  long i = (long)(p * (n - 1) + 0.5);
+
+  return sorted[i < n ? i : n - 1];
+}
+
+static void report(enum suite_op op, int nr_dev, int nr_thr, size_t block,
+                   uint64_t ns, uint64_t *lat, uint64_t bytes, long errors) {
+  long n = nr_thr * iterations, i;
+  double secs = ns / 1e9;
+  uint64_t sum = 0;
+
+  for (i = 0; i < n; i++) {
+    sum += lat[i];
+  }
+  qsort(lat, n, sizeof(*lat), cmp_u64);
+
+  if (csv) {
+    printf("%s,%s,%d,%d,%zu,%ld,%.6f,%.0f,%.2f,%llu,%llu,%llu,%llu,%llu,"
+           "%ld\n",
+           variant, op_names[op], nr_dev, nr_thr, block, n, secs, n / secs,
+           bytes / secs / 1e6, (unsigned long long)lat[0],
+           (unsigned long long)(sum / n),
+           (unsigned long long)percentile(lat, n, 0.5),
+           (unsigned long long)percentile(lat, n, 0.99),
+           (unsigned long long)lat[n - 1], errors);
+  } else {
+    printf("{\"bench\":\"suite\",\"variant\":\"%s\",\"op\":\"%s\","
+           "\"devices\":%d,\"threads\":%d,\"block\":%zu,\"ops\":%ld,"
+           "\"seconds\":%.6f,\"ops_per_s\":%.0f,\"mb_per_s\":%.2f,"
+           "\"min_ns\":%llu,\"avg_ns\":%llu,\"p50_ns\":%llu,\"p99_ns\":%llu,"
+           "\"max_ns\":%llu,\"errors\":%ld}\n",
+           variant, op_names[op], nr_dev, nr_thr, block, n, secs, n / secs,
+           bytes / secs / 1e6, (unsigned long long)lat[0],
+           (unsigned long long)(sum / n),
+           (unsigned long long)percentile(lat, n, 0.5),
+           (unsigned long long)percentile(lat, n, 0.99),
+           (unsigned long long)lat[n - 1], errors);
+  }
+  fflush(stdout);
+}
+
+static void run(enum suite_op op, const char **usable, int nr_dev, int nr_thr,
+                size_t block) {
+  struct worker *workers;
+  uint64_t start = UINT64_MAX, end = 0, bytes = 0, *lat;
+  long errors = 0;
+  int i;
+
+  workers = calloc(nr_thr, sizeof(*workers));
+  lat = calloc(nr_thr * iterations, sizeof(*lat));
+  if (!workers || !lat) {
+    die("cannot allocate", NULL);
+  }
+
+  pthread_barrier_init(&start_barrier, NULL, nr_thr);
+  for (i = 0; i < nr_thr; i++) {
+    workers[i].path = usable[i % nr_dev];
+    workers[i].op = op;
+    workers[i].block = block;
+    workers[i].id = i;
+    workers[i].lat = lat + i * iterations;
+    if (pthread_create(&workers[i].thread, NULL, worker_fn, &workers[i])) {
+      die("cannot create thread", NULL);
+    }
+  }
+
+  /*wall time from the first thread starting to the last one finishing*/
+  for (i = 0; i < nr_thr; i++) {
+    pthread_join(workers[i].thread, NULL);
+    start = (workers[i].start < start) ? workers[i].start : start;
+    end = (workers[i].end > end) ? workers[i].end : end;
+    bytes += workers[i].bytes;
+    errors += workers[i].errors;
+  }
+  pthread_barrier_destroy(&start_barrier);
+
+  report(op, nr_dev, nr_thr, block, end - start, lat, bytes, errors);
+
+  free(lat);
+  free(workers);
+}
+
+/*the devices op can open, a read only device is skipped for writes*/
+static int usable_paths(enum suite_op op, const char **usable) {
+  int i, fd, n = 0;
+
+  for (i = 0; i < nr_paths; i++) {
+    fd = open(paths[i], op_flags[op]);
+    if (fd < 0) {
+      fprintf(stderr, "pcd_suite: %s skips %s: %s\n", op_names[op], paths[i],
+              strerror(errno));
+      continue;
+    }
+    close(fd);
+    usable[n++] = paths[i];
+  }
+
+  return n;
+}
+
+static void run_op(enum suite_op op) {
+  const char *usable[MAX_LIST];
+  int nr_usable, d, t, b, nr_dev;
+  int sized = (op == OP_READ) || (op == OP_WRITE);
+
+  nr_usable = usable_paths(op, usable);
+  for (d = 0; d < nr_devices; d++) {
+    nr_dev = devices[d];
+    if (nr_dev > nr_usable) {
+      continue;
+    }
+    for (b = 0; b < (sized ? nr_blocks : 1); b++) {
+      for (t = 0; t < nr_threads; t++) {
+        run(op, usable, nr_dev, threads[t], sized ? blocks[b] : 0);
+      }
+    }
+  }
+}
+
+/*a comma separated list of positive numbers, returns how many*/
+static int parse_list(char *arg, long *list) {
+  char *tok, *save = NULL;
+  int n = 0;
+
+  for (tok = strtok_r(arg, ",", &save); tok && (n < MAX_LIST);
+       tok = strtok_r(NULL, ",", &save)) {
+    list[n] = strtol(tok, NULL, 0);
+    if (list[n] < 1) {
+      return 0;
+    }
+    n++;
+  }
+
+  return n;
+}
+
+static int parse_ops(char *arg) {
+  char *tok, *save = NULL;
+  int i, found;
+
+  memset(ops_enabled, 0, sizeof(ops_enabled));
+  for (tok = strtok_r(arg, ",", &save); tok;
+       tok = strtok_r(NULL, ",", &save)) {
+    found = 0;
+    for (i = 0; i < NR_OPS; i++) {
+      if (!strcmp(tok, op_names[i])) {
+        ops_enabled[i] = found = 1;
+      }
+    }
+    if (!found) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static void usage(void) {
+  fprintf(stderr,
+          "usage: pcd_suite -p path [-p path...] [-V variant] "
+          "[-o read,write,seek,openclose] [-b blocks] [-t threads] "
+          "[-d devices] [-n iterations] [--csv] [--no-header]\n"
+          "  -b, -t and -d take comma separated lists, -d defaults to 1 and "
+          "all devices\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  static int no_header;
+  static const struct option opts[] = {
+      {"csv", no_argument, &csv, 1},
+      {"no-header", no_argument, &no_header, 1},
+      {NULL, 0, NULL, 0}};
+  int c, i;
+
+  while ((c = getopt_long(argc, argv, "p:V:o:b:t:d:n:", opts, NULL)) != -1) {
+    switch (c) {
+    case 0:
+      break;
+    case 'p':
+      if (nr_paths == MAX_LIST) {
+        usage();
+      }
+      paths[nr_paths++] = optarg;
+      break;
+    case 'V':
+      variant = optarg;
+      break;
+    case 'o':
+      if (parse_ops(optarg)) {
+        usage();
+      }
+      break;
+    case 'b':
+      nr_blocks = parse_list(optarg, blocks);
+      break;
+    case 't':
+      nr_threads = parse_list(optarg, threads);
+      break;
+    case 'd':
+      nr_devices = parse_list(optarg, devices);
+      if (!nr_devices) {
+        usage();
+      }
+      break;
+    case 'n':
+      iterations = atol(optarg);
+      break;
+    default:
+      usage();
+    }
+  }
+  if (!nr_paths || !nr_blocks || !nr_threads || (iterations < 1)) {
+    usage();
+  }
+  if (!nr_devices) {
+    devices[nr_devices++] = 1;
+    if (nr_paths > 1) {
+      devices[nr_devices++] = nr_paths;
+    }
+  }
+
+  if (csv && !no_header) {
+    printf("variant,op,devices,threads,block,ops,seconds,ops_per_s,mb_per_s,"
+           "min_ns,avg_ns,p50_ns,p99_ns,max_ns,errors\n");
+  }
+  for (i = 0; i < NR_OPS; i++) {
+    if (ops_enabled[i]) {
+      run_op(i);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,27 @@
+#!/bin/sh
+# Run the pcd_m scaling benchmark on the host. Needs root. Loads pcd_m.ko
+# with a large pcdev-3, runs pcd_scale for writes and reads, disjoint and
+# overlapping, and prints the results to stdout, one JSON object per line.
+#
+#   ./run_pcd_bench.sh [max_threads] [pcd_scale options...]
+set -e
+
+PCD_M_DIR=$(dirname "$0")/../pseudo_char_driver_multiple
+CORE_DIR=$(dirname "$0")/../pcd_core
+BENCH=$(dirname "$0")/pcd_scale
+THREADS=${1:-$(nproc)}
+[ $# -gt 0 ] && shift
+
+cleanup() {
+	rmmod pcd_m 2>/dev/null || true
+	rmmod pcd_core 2>/dev/null || true
+}
+trap cleanup EXIT
+
+insmod "$CORE_DIR/pcd_core.ko"
+insmod "$PCD_M_DIR/pcd_m.ko" sizes=4096,4096,268435456,4096
+
+"$BENCH" -d /dev/pcdev-3 -t "$THREADS" "$@"
+"$BENCH" -d /dev/pcdev-3 -t "$THREADS" -o "$@"
+"$BENCH" -d /dev/pcdev-3 -t "$THREADS" -r "$@"
+"$BENCH" -d /dev/pcdev-3 -t "$THREADS" -r -o "$@"
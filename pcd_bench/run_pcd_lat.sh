@@ -0,0 +1,34 @@
+#!/bin/sh
+# Worst case syscall latency of the pcd_m data path on the host or the
+# board. Needs root. Loads pcd_m.ko with populate=1 so writes never
+# allocate, then times read and write on pcdev-3, idle and with stress
+# threads hammering the same device, and prints one JSON object per line.
+# Set GPIO_VALUE to a bone_gpios value attribute to also time GPIO writes.
+#
+#   ./run_pcd_lat.sh [stress_threads] [pcd_lat options...]
+set -e
+
+PCD_M_DIR=$(dirname "$0")/../pseudo_char_driver_multiple
+CORE_DIR=$(dirname "$0")/../pcd_core
+LAT=$(dirname "$0")/pcd_lat
+STRESS=${1:-$(nproc)}
+[ $# -gt 0 ] && shift
+
+cleanup() {
+	rmmod pcd_m 2>/dev/null || true
+	rmmod pcd_core 2>/dev/null || true
+}
+trap cleanup EXIT
+
+insmod "$CORE_DIR/pcd_core.ko"
+insmod "$PCD_M_DIR/pcd_m.ko" populate=1 sizes=4096,4096,1048576,4096
+
+for op in write read; do
+	"$LAT" -p /dev/pcdev-3 -m $op "$@"
+	"$LAT" -p /dev/pcdev-3 -m $op -s "$STRESS" "$@"
+done
+
+if [ -n "$GPIO_VALUE" ]; then
+	"$LAT" -p "$GPIO_VALUE" -m toggle "$@"
+	"$LAT" -p "$GPIO_VALUE" -m toggle -s "$STRESS" -S /dev/pcdev-3 "$@"
+fi
@@ -0,0 +1,50 @@
+#!/bin/sh
+# Probe and remove cost of pcd_platform_driver with many devices. Needs
+# root. Loads pcd_core and the driver, then pcd_device_setup.ko generating N
+# devices so every registration probes one, and unloads them again. Prints
+# one JSON object with the time and memory per device taken from their
+# kernel logs.
+#
+#   ./run_pcd_probe.sh [count] [pcd_device_setup parameters...]
+#   ./run_pcd_probe.sh 4096 size_dist=log sizes=64,65536
+set -e
+
+DIR=$(cd "$(dirname "$0")/../pcd_platform_driver" && pwd)
+COUNT=${1:-1000}
+[ $# -gt 0 ] && shift
+
+cleanup() {
+	rmmod pcd_device_setup 2>/dev/null || true
+	rmmod pcd_platform_driver 2>/dev/null || true
+	rmmod pcd_core 2>/dev/null || true
+}
+trap cleanup EXIT
+
+(cd "$DIR" && make host) >&2
+cleanup
+# only look at what this run logs
+SKIP=$(dmesg | wc -l)
+
+insmod "$DIR/../pcd_core/pcd_core.ko"
+insmod "$DIR/pcd_platform_driver.ko" max_devices="$COUNT"
+insmod "$DIR/pcd_device_setup.ko" count="$COUNT" "$@"
+rmmod pcd_device_setup
+rmmod pcd_platform_driver
+
+# registered N devices in X us, Y ns and about Z bytes per device
+# unregistered N devices in X us
+dmesg | tail -n +$((SKIP + 1)) | awk -v count="$COUNT" '
+/registered .* devices in .* per device/ {
+	for (i = 1; i <= NF; i++) {
+		if ($i == "in") probe_us = $(i + 1)
+		if ($i == "about") bytes = $(i + 1)
+	}
+}
+/unregistered .* devices in/ {
+	for (i = 1; i <= NF; i++) if ($i == "in") remove_us = $(i + 1)
+}
+END {
+	printf "{\"bench\":\"probe\",\"devices\":%d,\"probe_us\":%d,", count, probe_us
+	printf "\"probe_ns_per_dev\":%d,\"remove_us\":%d,", probe_us * 1000 / count, remove_us
+	printf "\"remove_ns_per_dev\":%d,\"bytes_per_dev\":%d}\n", remove_us * 1000 / count, bytes
+}'
@@ -0,0 +1,102 @@
+#!/bin/sh
+# Run pcd_suite against every pcd variant on the host. Needs root. Builds
+# each variant with its `host` target, loads it (the platform drivers
+# together with pcd_device_setup.ko, which stands in for the device tree),
+# benchmarks its device files and unloads it again before the next one, as
+# most variants share the pcd_class name.
+#
+#   ./run_pcd_suite.sh [pcd_suite options...] > results.json
+#   VARIANTS="pcd_m pcd_sysfs" ./run_pcd_suite.sh --csv > results.csv
+set -e
+
+TOP=$(cd "$(dirname "$0")/.." && pwd)
+SUITE=$TOP/pcd_bench/pcd_suite
+SETUP=$TOP/pcd_platform_driver/pcd_device_setup.ko
+VARIANTS=${VARIANTS:-"pcd pcd_m pcd_platform pcd_dt pcd_sysfs"}
+HEADER=
+
+cleanup() {
+	for mod in pcd pcd_m pcd_platform_driver \
+		pcd_platform_driver_device_tree pcd_sysfs pcd_device_setup \
+		pcd_core; do
+		rmmod $mod 2>/dev/null || true
+	done
+}
+trap cleanup EXIT
+
+# the core stays loaded for every variant after the first that needs it
+load_core() {
+	grep -q '^pcd_core ' /proc/modules || insmod "$TOP/pcd_core/pcd_core.ko"
+}
+
+# the Makefiles pass M=$(PWD), so build from inside the directory. kbuild
+# output goes to stderr, stdout only carries results
+build() {
+	(cd "$TOP/$1" && make host) >&2
+}
+
+# run the suite on the given device files, only the first run of a CSV
+# report prints the header
+bench() {
+	variant=$1
+	shift
+	udevadm settle 2>/dev/null || sleep 1
+	set -- $(for dev in "$@"; do echo -p "$dev"; done)
+	"$SUITE" -V "$variant" $HEADER "$@" $ARGS
+	HEADER=--no-header
+}
+
+ARGS="$*"
+cleanup
+
+for variant in $VARIANTS; do
+	case $variant in
+	pcd)
+		build pseudo_char_driver
+		load_core
+		insmod "$TOP/pseudo_char_driver/pcd.ko"
+		bench pcd /dev/pcd
+		rmmod pcd
+		;;
+	pcd_m)
+		build pseudo_char_driver_multiple
+		load_core
+		insmod "$TOP/pseudo_char_driver_multiple/pcd_m.ko" \
+			sizes=4096,4096,1048576,4096
+		bench pcd_m /dev/pcdev-1 /dev/pcdev-2 /dev/pcdev-3 /dev/pcdev-4
+		rmmod pcd_m
+		;;
+	pcd_platform)
+		build pcd_platform_driver
+		insmod "$SETUP"
+		load_core
+		insmod "$TOP/pcd_platform_driver/pcd_platform_driver.ko"
+		bench pcd_platform /dev/pcdev-0 /dev/pcdev-1 /dev/pcdev-2 \
+			/dev/pcdev-3
+		rmmod pcd_platform_driver pcd_device_setup
+		;;
+	pcd_dt)
+		build pcd_platform_driver
+		build pcd_platform_driver_device_tree
+		insmod "$SETUP"
+		load_core
+		insmod "$TOP/pcd_platform_driver_device_tree/pcd_platform_driver_device_tree.ko"
+		bench pcd_dt /dev/pcdev-0 /dev/pcdev-1 /dev/pcdev-2 /dev/pcdev-3
+		rmmod pcd_platform_driver_device_tree pcd_device_setup
+		;;
+	pcd_sysfs)
+		build pcd_platform_driver
+		build pcd_sysfs
+		insmod "$SETUP"
+		load_core
+		insmod "$TOP/pcd_sysfs/pcd_sysfs.ko"
+		bench pcd_sysfs /dev/pcdev-0 /dev/pcdev-1 /dev/pcdev-2 \
+			/dev/pcdev-3
+		rmmod pcd_sysfs pcd_device_setup
+		;;
+	*)
+		echo "unknown variant $variant" >&2
+		exit 1
+		;;
+	esac
+done
@@ -0,0 +1,159 @@
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+#include "pcd_core.h"
+
+/*
+ * contig and vmalloc keep the device in one flat buffer, from kzalloc and
+ * vzalloc. kzalloc is physically contiguous and cheapest to copy from but
+ * large sizes may fail to allocate, vzalloc takes any size.
+ *
+ * pages allocates a page on the first write to it, holes read back as
+ * zeros. Large, mostly empty devices only cost the page array.
+ */
+
+/*every backend returns the bytes copied before a fault, -EFAULT only when
+ * there are none*/
+static ssize_t pcd_flat_read(struct pcd_storage *st, char __user *buff,
+                             size_t count, loff_t pos) {
+  size_t left = copy_to_user(buff, st->priv + pos, count);
+
+  return (left == count) ? -EFAULT : count - left;
+}
+
+static ssize_t pcd_flat_write(struct pcd_storage *st, const char __user *buff,
+                              size_t count, loff_t pos) {
+  size_t left = copy_from_user(st->priv + pos, buff, count);
+
+  return (left == count) ? -EFAULT : count - left;
+}
+
+static int pcd_contig_init(struct pcd_storage *st) {
+  st->priv = kzalloc(st->size, GFP_KERNEL);
+  return st->priv ? 0 : -ENOMEM;
+}
+
+static void pcd_contig_free(struct pcd_storage *st) { kfree(st->priv); }
+
+struct pcd_backend pcd_backend_contig = {.name = "contig",
+                                         .owner = THIS_MODULE,
+                                         .init = pcd_contig_init,
+                                         .free = pcd_contig_free,
+                                         .read = pcd_flat_read,
+                                         .write = pcd_flat_write};
+
+static int pcd_vmalloc_init(struct pcd_storage *st) {
+  st->priv = vzalloc(st->size);
+  return st->priv ? 0 : -ENOMEM;
+}
+
+static void pcd_vmalloc_free(struct pcd_storage *st) { vfree(st->priv); }
+
+struct pcd_backend pcd_backend_vmalloc = {.name = "vmalloc",
+                                          .owner = THIS_MODULE,
+                                          .init = pcd_vmalloc_init,
+                                          .free = pcd_vmalloc_free,
+                                          .read = pcd_flat_read,
+                                          .write = pcd_flat_write};
+
+static int pcd_pages_init(struct pcd_storage *st) {
+  st->priv = kvcalloc(DIV_ROUND_UP(st->size, PAGE_SIZE), sizeof(struct page *),
+                      GFP_KERNEL);
+  return st->priv ? 0 : -ENOMEM;
+}
+
+static void pcd_pages_free(struct pcd_storage *st) {
+  struct page **pages = st->priv;
+  unsigned long i;
+
+  for (i = 0; i < DIV_ROUND_UP(st->size, PAGE_SIZE); i++) {
+    if (pages[i]) {
+      __free_page(pages[i]);
+    }
+  }
+  kvfree(pages);
+}
+
+/*the page at index, allocated if it is a hole. Writers racing for the same
+ * hole install one page, the others free theirs*/
+static struct page *pcd_pages_get(struct pcd_storage *st, unsigned long index) {
+  struct page **pages = st->priv;
+  struct page *page, *old;
+
+  page = READ_ONCE(pages[index]);
+  if (page) {
+    return page;
+  }
+
+  /*lowmem, the copies go through page_address*/
+  page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+  if (!page) {
+    return NULL;
+  }
+  old = cmpxchg(&pages[index], NULL, page);
+  if (old) {
+    __free_page(page);
+    return old;
+  }
+
+  return page;
+}
+
+static ssize_t pcd_pages_read(struct pcd_storage *st, char __user *buff,
+                              size_t count, loff_t pos) {
+  struct page **pages = st->priv;
+  size_t done = 0, off, len;
+  struct page *page;
+  size_t left;
+
+  while (done < count) {
+    off = (pos + done) & ~PAGE_MASK;
+    len = min_t(size_t, count - done, PAGE_SIZE - off);
+    /*pairs with the cmpxchg that installed the zeroed page*/
+    page = smp_load_acquire(&pages[(pos + done) >> PAGE_SHIFT]);
+    if (page) {
+      left = copy_to_user(buff + done, page_address(page) + off, len);
+    } else {
+      left = clear_user(buff + done, len);
+    }
+    if (left) {
+      done += len - left;
+      return done ? done : -EFAULT;
+    }
+    done += len;
+  }
+
+  return count;
+}
+
+static ssize_t pcd_pages_write(struct pcd_storage *st, const char __user *buff,
+                               size_t count, loff_t pos) {
+  size_t done = 0, off, len;
+  struct page *page;
+  size_t left;
+
+  while (done < count) {
+    off = (pos + done) & ~PAGE_MASK;
+    len = min_t(size_t, count - done, PAGE_SIZE - off);
+    page = pcd_pages_get(st, (pos + done) >> PAGE_SHIFT);
+    if (!page) {
+      return done ? done : -ENOMEM;
+    }
+    left = copy_from_user(page_address(page) + off, buff + done, len);
+    if (left) {
+      done += len - left;
+      return done ? done : -EFAULT;
+    }
+    done += len;
+  }
+
+  return count;
+}
+
+struct pcd_backend pcd_backend_pages = {.name = "pages",
+                                        .owner = THIS_MODULE,
+                                        .init = pcd_pages_init,
+                                        .free = pcd_pages_free,
+                                        .read = pcd_pages_read,
+                                        .write = pcd_pages_write};
@@ -0,0 +1,96 @@
+#ifndef PCD_CORE_H
+#define PCD_CORE_H
+#include <linux/fs.h>
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/uaccess.h>
+
+/*
+ * Shared pieces of the pcd drivers: the permission check, seek and count
+ * bounds, and device memory behind a storage backend chosen per device.
+ */
+
+/*File access modes, the same values every driver's platform data uses*/
+#define PCD_RDONLY 0x01
+#define PCD_WRONLY 0x10
+#define PCD_RDWR 0x11
+
+/*the backend a device gets when none is named*/
+#define PCD_DEFAULT_BACKEND "contig"
+
+struct pcd_storage;
+
+/*A storage backend. read and write are called with a range inside the
+ * device and return the bytes copied or an error. Serializing accesses to
+ * the same bytes is up to the driver*/
+struct pcd_backend {
+  const char *name;
+  struct module *owner;
+  int (*init)(struct pcd_storage *st);
+  void (*free)(struct pcd_storage *st);
+  ssize_t (*read)(struct pcd_storage *st, char __user *buff, size_t count,
+                  loff_t pos);
+  ssize_t (*write)(struct pcd_storage *st, const char __user *buff,
+                   size_t count, loff_t pos);
+  struct list_head list;
+};
+
+/*Device memory of one device*/
+struct pcd_storage {
+  const struct pcd_backend *backend;
+  size_t size;
+  /*the backend's, a buffer or a page array*/
+  void *priv;
+};
+
+int pcd_backend_register(struct pcd_backend *backend);
+void pcd_backend_unregister(struct pcd_backend *backend);
+
+int pcd_storage_init(struct pcd_storage *st, const char *backend, size_t size);
+void pcd_storage_free(struct pcd_storage *st);
+
+static inline ssize_t pcd_storage_read(struct pcd_storage *st,
+                                       char __user *buff, size_t count,
+                                       loff_t pos) {
+  return count ? st->backend->read(st, buff, count, pos) : 0;
+}
+
+static inline ssize_t pcd_storage_write(struct pcd_storage *st,
+                                        const char __user *buff, size_t count,
+                                        loff_t pos) {
+  return count ? st->backend->write(st, buff, count, pos) : 0;
+}
+
+int pcd_core_check_permission(int dev_perm, fmode_t f_mode);
+loff_t pcd_core_llseek(struct file *filep, loff_t offset, int whence,
+                       loff_t size);
+
+/*count cut down to what is left of a size byte device at pos, 0 at or past
+ * the end*/
+static inline size_t pcd_core_clamp(loff_t pos, size_t count, loff_t size) {
+  if (pos >= size) {
+    return 0;
+  }
+
+  return min_t(u64, count, size - pos);
+}
+
+/*bytes a write of count at pos may copy into a size byte device, 0 for an
+ * empty write and -ENOSPC when no room is left at pos*/
+static inline ssize_t pcd_core_write_count(loff_t pos, size_t count,
+                                           loff_t size) {
+  if (!count) {
+    return 0;
+  }
+
+  count = pcd_core_clamp(pos, count, size);
+
+  return count ? count : -ENOSPC;
+}
+
+/*built in backends, in pcd_backend.c*/
+extern struct pcd_backend pcd_backend_contig;
+extern struct pcd_backend pcd_backend_vmalloc;
+extern struct pcd_backend pcd_backend_pages;
+
+#endif
@@ -0,0 +1,159 @@
+#include <linux/mutex.h>
+
+#include "pcd_core.h"
+
+#undef pr_fmt
+#define pr_fmt(fmt) "%s :" fmt, __func__
+
+/*registered backends, other modules can add their own*/
+static LIST_HEAD(pcd_backends);
+static DEFINE_MUTEX(pcd_backends_lock);
+
+static struct pcd_backend *pcd_backend_find(const char *name) {
+  struct pcd_backend *backend;
+
+  list_for_each_entry(backend, &pcd_backends, list) {
+    if (!strcmp(backend->name, name)) {
+      return backend;
+    }
+  }
+
+  return NULL;
+}
+
+int pcd_backend_register(struct pcd_backend *backend) {
+  int ret = 0;
+
+  mutex_lock(&pcd_backends_lock);
+  if (pcd_backend_find(backend->name)) {
+    ret = -EEXIST;
+  } else {
+    list_add_tail(&backend->list, &pcd_backends);
+  }
+  mutex_unlock(&pcd_backends_lock);
+
+  return ret;
+}
+EXPORT_SYMBOL_GPL(pcd_backend_register);
+
+void pcd_backend_unregister(struct pcd_backend *backend) {
+  mutex_lock(&pcd_backends_lock);
+  list_del(&backend->list);
+  mutex_unlock(&pcd_backends_lock);
+}
+EXPORT_SYMBOL_GPL(pcd_backend_unregister);
+
+/*set up size bytes of zeroed device memory on the named backend, the
+ * default one for NULL. The backend's module stays pinned until it is
+ * freed*/
+int pcd_storage_init(struct pcd_storage *st, const char *backend,
+                     size_t size) {
+  struct pcd_backend *b;
+  int ret;
+
+  mutex_lock(&pcd_backends_lock);
+  b = pcd_backend_find(backend ? backend : PCD_DEFAULT_BACKEND);
+  if (b && !try_module_get(b->owner)) {
+    b = NULL;
+  }
+  mutex_unlock(&pcd_backends_lock);
+  if (!b) {
+    return -ENOENT;
+  }
+
+  st->backend = b;
+  st->size = size;
+  ret = b->init(st);
+  if (ret) {
+    module_put(b->owner);
+    st->backend = NULL;
+  }
+
+  return ret;
+}
+EXPORT_SYMBOL_GPL(pcd_storage_init);
+
+void pcd_storage_free(struct pcd_storage *st) {
+  if (!st->backend) {
+    return;
+  }
+
+  st->backend->free(st);
+  module_put(st->backend->owner);
+  st->backend = NULL;
+  st->priv = NULL;
+}
+EXPORT_SYMBOL_GPL(pcd_storage_free);
+
+int pcd_core_check_permission(int dev_perm, fmode_t f_mode) {
+  if (dev_perm == PCD_RDWR) {
+    return 0;
+  }
+
+  // Ensure read only actions
+  if ((dev_perm == PCD_RDONLY) &&
+      ((f_mode & FMODE_READ) && !(f_mode & FMODE_WRITE))) {
+    return 0;
+  }
+
+  // Ensure write only actions
+  if ((dev_perm == PCD_WRONLY) &&
+      ((f_mode & FMODE_WRITE) && !(f_mode & FMODE_READ))) {
+    return 0;
+  }
+
+  return -EPERM;
+}
+EXPORT_SYMBOL_GPL(pcd_core_check_permission);
+
+/*seek within a size byte device, positions outside of it are -EINVAL*/
+loff_t pcd_core_llseek(struct file *filep, loff_t offset, int whence,
+                       loff_t size) {
+  loff_t temp = 0;
+
+  switch (whence) {
+  case SEEK_SET:
+    temp = offset;
+    break;
+  case SEEK_CUR:
+    temp = filep->f_pos + offset;
+    break;
+  case SEEK_END:
+    temp = size + offset;
+    break;
+  default:
+    return -EINVAL;
+  }
+
+  if ((temp > size) || (temp < 0)) {
+    return -EINVAL;
+  }
+  filep->f_pos = temp;
+
+  return filep->f_pos;
+}
+EXPORT_SYMBOL_GPL(pcd_core_llseek);
+
+static int __init pcd_core_init(void) {
+  pcd_backend_register(&pcd_backend_contig);
+  pcd_backend_register(&pcd_backend_vmalloc);
+  pcd_backend_register(&pcd_backend_pages);
+
+  pr_info("pcd core loaded\n");
+  return 0;
+}
+
+static void __exit pcd_core_exit(void) {
+  pcd_backend_unregister(&pcd_backend_pages);
+  pcd_backend_unregister(&pcd_backend_vmalloc);
+  pcd_backend_unregister(&pcd_backend_contig);
+
+  pr_info("pcd core unloaded\n");
+}
+
+module_init(pcd_core_init);
+module_exit(pcd_core_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Yusuf Atalay");
+MODULE_DESCRIPTION("Shared storage backends and helpers of the pcd drivers");
@@ -0,0 +1,282 @@
+#include <kunit/test.h>
+#include <linux/ktime.h>
+#include <linux/mman.h>
+#include <linux/version.h>
+
+#include "pcd_core.h"
+
+/*
+ * KUnit suite of pcd_core: the permission check, seek and count bounds at
+ * the edges of a device, and the copy paths of every storage backend. The
+ * bench cases time pcd_storage_read/write and log the cost per copy.
+ */
+
+static unsigned int bench_iterations = 10000;
+module_param(bench_iterations, uint, 0444);
+MODULE_PARM_DESC(bench_iterations, "copies per size in the bench cases");
+
+/*device size of the storage cases, the pages backend spans several pages*/
+#define PCD_TEST_SIZE (4 * PAGE_SIZE)
+
+static const char *const pcd_core_test_backends[] = {"contig", "vmalloc",
+                                                     "pages"};
+
+static void pcd_core_test_backend_desc(const char *const *backend,
+                                       char *desc) {
+  strscpy(desc, *backend, KUNIT_PARAM_DESC_SIZE);
+}
+
+KUNIT_ARRAY_PARAM(pcd_core_test_backend, pcd_core_test_backends,
+                  pcd_core_test_backend_desc);
+
+static void pcd_core_test_permission(struct kunit *test) {
+  fmode_t rd = FMODE_READ, wr = FMODE_WRITE, rdwr = FMODE_READ | FMODE_WRITE;
+
+  KUNIT_EXPECT_EQ(test, pcd_core_check_permission(PCD_RDWR, rd), 0);
+  KUNIT_EXPECT_EQ(test, pcd_core_check_permission(PCD_RDWR, wr), 0);
+  KUNIT_EXPECT_EQ(test, pcd_core_check_permission(PCD_RDWR, rdwr), 0);
+
+  KUNIT_EXPECT_EQ(test, pcd_core_check_permission(PCD_RDONLY, rd), 0);
+  KUNIT_EXPECT_EQ(test, pcd_core_check_permission(PCD_RDONLY, wr), -EPERM);
+  KUNIT_EXPECT_EQ(test, pcd_core_check_permission(PCD_RDONLY, rdwr), -EPERM);
+
+  KUNIT_EXPECT_EQ(test, pcd_core_check_permission(PCD_WRONLY, wr), 0);
+  KUNIT_EXPECT_EQ(test, pcd_core_check_permission(PCD_WRONLY, rd), -EPERM);
+  KUNIT_EXPECT_EQ(test, pcd_core_check_permission(PCD_WRONLY, rdwr), -EPERM);
+
+  /*an unknown permission grants nothing*/
+  KUNIT_EXPECT_EQ(test, pcd_core_check_permission(0, rdwr), -EPERM);
+}
+
+static void pcd_core_test_llseek(struct kunit *test) {
+  struct file *filep = kunit_kzalloc(test, sizeof(*filep), GFP_KERNEL);
+  loff_t size = 512;
+
+  KUNIT_ASSERT_NOT_NULL(test, filep);
+
+  /*the end of the device is a valid position, one past it is not*/
+  KUNIT_EXPECT_EQ(test, pcd_core_llseek(filep, size, SEEK_SET, size), size);
+  KUNIT_EXPECT_EQ(test, pcd_core_llseek(filep, size + 1, SEEK_SET, size),
+                  -EINVAL);
+  KUNIT_EXPECT_EQ(test, filep->f_pos, size);
+
+  KUNIT_EXPECT_EQ(test, pcd_core_llseek(filep, 0, SEEK_END, size), size);
+  KUNIT_EXPECT_EQ(test, pcd_core_llseek(filep, 1, SEEK_END, size), -EINVAL);
+  KUNIT_EXPECT_EQ(test, pcd_core_llseek(filep, -size, SEEK_END, size), 0);
+
+  /*negative positions, a failed seek leaves f_pos alone*/
+  KUNIT_EXPECT_EQ(test, pcd_core_llseek(filep, -1, SEEK_SET, size), -EINVAL);
+  KUNIT_EXPECT_EQ(test, pcd_core_llseek(filep, 10, SEEK_SET, size), 10);
+  KUNIT_EXPECT_EQ(test, pcd_core_llseek(filep, -11, SEEK_CUR, size),
+                  -EINVAL);
+  KUNIT_EXPECT_EQ(test, pcd_core_llseek(filep, -10, SEEK_CUR, size), 0);
+  KUNIT_EXPECT_EQ(test, pcd_core_llseek(filep, size + 1, SEEK_CUR, size),
+                  -EINVAL);
+  KUNIT_EXPECT_EQ(test, filep->f_pos, 0);
+
+  KUNIT_EXPECT_EQ(test, pcd_core_llseek(filep, 0, SEEK_DATA, size), -EINVAL);
+}
+
+static void pcd_core_test_clamp(struct kunit *test) {
+  loff_t size = 512;
+
+  KUNIT_EXPECT_EQ(test, pcd_core_clamp(0, 100, size), 100);
+  KUNIT_EXPECT_EQ(test, pcd_core_clamp(0, size, size), size);
+  KUNIT_EXPECT_EQ(test, pcd_core_clamp(500, 100, size), 12);
+  KUNIT_EXPECT_EQ(test, pcd_core_clamp(size - 1, 100, size), 1);
+
+  /*offset == size, and a pread past the end*/
+  KUNIT_EXPECT_EQ(test, pcd_core_clamp(size, 100, size), 0);
+  KUNIT_EXPECT_EQ(test, pcd_core_clamp(size + 1, 100, size), 0);
+  KUNIT_EXPECT_EQ(test, pcd_core_clamp(LLONG_MAX, 100, size), 0);
+
+  KUNIT_EXPECT_EQ(test, pcd_core_clamp(0, 0, size), 0);
+  KUNIT_EXPECT_EQ(test, pcd_core_clamp(0, SIZE_MAX, size), size);
+}
+
+/*storage of the case's backend, freed by the suite's exit*/
+static struct pcd_storage *pcd_core_test_storage(struct kunit *test,
+                                                 size_t size) {
+  const char *const *backend = test->param_value;
+  struct pcd_storage *st;
+
+  st = kunit_kzalloc(test, sizeof(*st), GFP_KERNEL);
+  KUNIT_ASSERT_NOT_NULL(test, st);
+  KUNIT_ASSERT_EQ(test, pcd_storage_init(st, *backend, size), 0);
+  test->priv = st;
+
+  return st;
+}
+
+/*user memory the copy paths can work on, mapped for the test's life*/
+static char __user *pcd_core_test_user_buf(struct kunit *test, size_t size) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 11, 0)
+  unsigned long addr;
+
+  addr = kunit_vm_mmap(test, NULL, 0, size, PROT_READ | PROT_WRITE,
+                       MAP_ANONYMOUS | MAP_PRIVATE, 0);
+  if (!addr || IS_ERR_VALUE(addr)) {
+    kunit_skip(test, "cannot map user memory");
+  }
+
+  return (char __user *)addr;
+#else
+  kunit_skip(test, "needs kunit_vm_mmap, 6.11 or later");
+  return NULL;
+#endif
+}
+
+static void pcd_core_test_copy(struct kunit *test) {
+  struct pcd_storage *st = pcd_core_test_storage(test, PCD_TEST_SIZE);
+  char __user *ubuf = pcd_core_test_user_buf(test, 2 * PCD_TEST_SIZE);
+  size_t len = PAGE_SIZE + 100;
+  loff_t pos = PAGE_SIZE - 50;
+  char *in, *out;
+  size_t i;
+
+  in = kunit_kmalloc(test, len, GFP_KERNEL);
+  out = kunit_kzalloc(test, PCD_TEST_SIZE, GFP_KERNEL);
+  KUNIT_ASSERT_NOT_NULL(test, in);
+  KUNIT_ASSERT_NOT_NULL(test, out);
+  for (i = 0; i < len; i++) {
+    in[i] = i % 251 + 1;
+  }
+  KUNIT_ASSERT_EQ(test, copy_to_user(ubuf, in, len), 0);
+
+  /*a record across two page boundaries reads back unchanged*/
+  KUNIT_EXPECT_EQ(test, pcd_storage_write(st, ubuf, len, pos), (ssize_t)len);
+  KUNIT_EXPECT_EQ(test,
+                  pcd_storage_read(st, ubuf + PCD_TEST_SIZE, len, pos),
+                  (ssize_t)len);
+  KUNIT_ASSERT_EQ(test, copy_from_user(out, ubuf + PCD_TEST_SIZE, len), 0);
+  KUNIT_EXPECT_EQ(test, memcmp(in, out, len), 0);
+
+  /*memory never written reads as zeros, a hole on the pages backend*/
+  KUNIT_EXPECT_EQ(test,
+                  pcd_storage_read(st, ubuf, PAGE_SIZE, 3 * PAGE_SIZE),
+                  (ssize_t)PAGE_SIZE);
+  KUNIT_ASSERT_EQ(test, copy_from_user(out, ubuf, PAGE_SIZE), 0);
+  KUNIT_EXPECT_PTR_EQ(test, memchr_inv(out, 0, PAGE_SIZE), NULL);
+
+  /*the last byte of the device*/
+  KUNIT_EXPECT_EQ(test,
+                  pcd_storage_write(st, ubuf + 1, 1, PCD_TEST_SIZE - 1), 1);
+}
+
+static void pcd_core_test_zero_length(struct kunit *test) {
+  struct pcd_storage *st = pcd_core_test_storage(test, PCD_TEST_SIZE);
+  char __user *ubuf = pcd_core_test_user_buf(test, PAGE_SIZE);
+
+  KUNIT_EXPECT_EQ(test, pcd_storage_write(st, ubuf, 0, 0), 0);
+  KUNIT_EXPECT_EQ(test, pcd_storage_read(st, ubuf, 0, 0), 0);
+
+  /*at offset == size, which the drivers pass through after the clamp*/
+  KUNIT_EXPECT_EQ(test, pcd_storage_write(st, ubuf, 0, PCD_TEST_SIZE), 0);
+  KUNIT_EXPECT_EQ(test, pcd_storage_read(st, ubuf, 0, PCD_TEST_SIZE), 0);
+  KUNIT_EXPECT_EQ(test,
+                  pcd_storage_write(st, ubuf,
+                                    pcd_core_clamp(PCD_TEST_SIZE, PAGE_SIZE,
+                                                   PCD_TEST_SIZE),
+                                    PCD_TEST_SIZE),
+                  0);
+}
+
+/*the write() decision every frontend makes before touching the storage*/
+static void pcd_core_test_write_count(struct kunit *test) {
+  /*an empty write succeeds wherever it lands*/
+  KUNIT_EXPECT_EQ(test, pcd_core_write_count(0, 0, PCD_TEST_SIZE), 0);
+  KUNIT_EXPECT_EQ(test, pcd_core_write_count(PCD_TEST_SIZE, 0, PCD_TEST_SIZE),
+                  0);
+  KUNIT_EXPECT_EQ(
+      test, pcd_core_write_count(PCD_TEST_SIZE + 1, 0, PCD_TEST_SIZE), 0);
+
+  /*no room at or past the end*/
+  KUNIT_EXPECT_EQ(test, pcd_core_write_count(PCD_TEST_SIZE, 1, PCD_TEST_SIZE),
+                  -ENOSPC);
+  KUNIT_EXPECT_EQ(
+      test, pcd_core_write_count(PCD_TEST_SIZE + 1, 1, PCD_TEST_SIZE),
+      -ENOSPC);
+
+  /*cut down to what is left, untouched when it fits*/
+  KUNIT_EXPECT_EQ(
+      test, pcd_core_write_count(PCD_TEST_SIZE - 1, 16, PCD_TEST_SIZE), 1);
+  KUNIT_EXPECT_EQ(test, pcd_core_write_count(0, PCD_TEST_SIZE, PCD_TEST_SIZE),
+                  PCD_TEST_SIZE);
+  KUNIT_EXPECT_EQ(test, pcd_core_write_count(0, 16, PCD_TEST_SIZE), 16);
+}
+
+/*time bench_iterations copies of each size, walking over the device so the
+ * pages backend pays for allocating every page once*/
+static void pcd_core_test_bench(struct kunit *test) {
+  static const size_t sizes[] = {64, 4096};
+  const char *const *backend = test->param_value;
+  struct pcd_storage *st = pcd_core_test_storage(test, PCD_TEST_SIZE);
+  char __user *ubuf = pcd_core_test_user_buf(test, PAGE_SIZE);
+  unsigned int n = max(bench_iterations, 1U);
+  s64 write_ns, read_ns;
+  unsigned int i, s;
+  ktime_t start;
+  loff_t pos;
+
+  for (s = 0; s < ARRAY_SIZE(sizes); s++) {
+    /*checked after the loops, an assertion per copy would be timed too*/
+    start = ktime_get();
+    for (i = 0, pos = 0; i < n; i++) {
+      if (pcd_storage_write(st, ubuf, sizes[s], pos) != (ssize_t)sizes[s]) {
+        break;
+      }
+      pos = (pos + sizes[s]) % PCD_TEST_SIZE;
+    }
+    write_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+    KUNIT_ASSERT_EQ(test, i, n);
+
+    start = ktime_get();
+    for (i = 0, pos = 0; i < n; i++) {
+      if (pcd_storage_read(st, ubuf, sizes[s], pos) != (ssize_t)sizes[s]) {
+        break;
+      }
+      pos = (pos + sizes[s]) % PCD_TEST_SIZE;
+    }
+    read_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+    KUNIT_ASSERT_EQ(test, i, n);
+
+    kunit_info(test, "%s %zu bytes: write %lld ns, read %lld ns per copy\n",
+               *backend, sizes[s], div_s64(write_ns, n), div_s64(read_ns, n));
+  }
+}
+
+static int pcd_core_test_init(struct kunit *test) {
+  test->priv = NULL;
+
+  return 0;
+}
+
+static void pcd_core_test_exit(struct kunit *test) {
+  if (test->priv) {
+    pcd_storage_free(test->priv);
+  }
+}
+
+static struct kunit_case pcd_core_test_cases[] = {
+    KUNIT_CASE(pcd_core_test_permission),
+    KUNIT_CASE(pcd_core_test_llseek),
+    KUNIT_CASE(pcd_core_test_clamp),
+    KUNIT_CASE_PARAM(pcd_core_test_copy, pcd_core_test_backend_gen_params),
+    KUNIT_CASE_PARAM(pcd_core_test_zero_length,
+                     pcd_core_test_backend_gen_params),
+    KUNIT_CASE(pcd_core_test_write_count),
+    KUNIT_CASE_PARAM(pcd_core_test_bench, pcd_core_test_backend_gen_params),
+    {}};
+
+static struct kunit_suite pcd_core_test_suite = {
+    .name = "pcd_core",
+    .init = pcd_core_test_init,
+    .exit = pcd_core_test_exit,
+    .test_cases = pcd_core_test_cases,
+};
+
+kunit_test_suite(pcd_core_test_suite);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Yusuf Atalay");
+MODULE_DESCRIPTION("KUnit tests of the pcd_core helpers and backends");
@@ -1,63 +1,204 @@
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/platform_device.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/version.h>
 
 #include "platform.h"
 
 #undef pr_fmt
 #define pr_fmt(fmt) "%s :" fmt, __func__
 
-void pcdev_release(struct device *dev) { pr_info("Device relased\n"); }
-
-/*Create 2 platform data*/
-struct pcdev_platform_data pcdev_pdata[4] = {
-    [0] = {.size = 512, .perm = RDWR, .serial_number = "PCDEV_SR_1"},
-    [1] = {.size = 1024, .perm = RDWR, .serial_number = "PCDEV_SR_2"},
-    [2] = {.size = 256, .perm = RDONLY, .serial_number = "PCDEV_SR_3"},
-    [3] = {.size = 2048, .perm = WRONLY, .serial_number = "PCDEV_SR_4"},
-};
-
-/*Create 2 platform devices*/
-
-struct platform_device platform_pcdev_1 = {
-    .name = "pcdev-A1X",
-    .id = 0,
-    .dev = {.platform_data = &pcdev_pdata[0], .release = pcdev_release}};
-
-struct platform_device platform_pcdev_2 = {
-    .name = "pcdev-B1X",
-    .id = 1,
-    .dev = {.platform_data = &pcdev_pdata[1], .release = pcdev_release}};
-
-struct platform_device platform_pcdev_3 = {
-    .name = "pcdev-C1X",
-    .id = 2,
-    .dev = {.platform_data = &pcdev_pdata[2], .release = pcdev_release}};
-
-struct platform_device platform_pcdev_4 = {
-    .name = "pcdev-D1X",
-    .id = 3,
-    .dev = {.platform_data = &pcdev_pdata[3], .release = pcdev_release}};
-
-struct platform_device *platform_pcdevs[] = {
-    &platform_pcdev_1,
-    &platform_pcdev_2,
-    &platform_pcdev_3,
-    &platform_pcdev_4,
-};
+/*
+ * Generates platform devices for the pcd platform drivers. Device i gets
+ * id i, the i-th entry (cycling) of names and perms and a size picked by
+ * size_dist. The defaults register the four devices the drivers know.
+ */
+
+static unsigned int count = 4;
+module_param(count, uint, 0444);
+MODULE_PARM_DESC(count, "number of devices to register");
+
+static unsigned int sizes[16] = {512, 1024, 256, 2048};
+static int nr_sizes = 4;
+module_param_array(sizes, uint, &nr_sizes, 0444);
+MODULE_PARM_DESC(sizes, "device sizes in bytes, see size_dist");
+
+static char *size_dist = "cycle";
+module_param(size_dist, charp, 0444);
+MODULE_PARM_DESC(size_dist,
+                 "cycle through sizes, uniform or log (power of two) "
+                 "between sizes[0] and sizes[1]");
+
+static char *perms[16] = {"rw", "rw", "r", "w"};
+static int nr_perms = 4;
+module_param_array(perms, charp, &nr_perms, 0444);
+MODULE_PARM_DESC(perms, "device permissions to cycle through, rw, r or w");
+
+static char *names[16] = {"pcdev-A1X", "pcdev-B1X", "pcdev-C1X", "pcdev-D1X"};
+static int nr_names = 4;
+module_param_array(names, charp, &nr_names, 0444);
+MODULE_PARM_DESC(names, "device names to cycle through, as in the driver's "
+                        "id table");
+
+static char *storage;
+module_param(storage, charp, 0444);
+MODULE_PARM_DESC(storage, "pcd_core storage backend of every device, for "
+                          "the drivers that use pcd_core");
+
+static struct platform_device **pcdevs;
+static char **serials;
+static unsigned int nr_pcdevs;
+
+static int pcdev_parse_perm(const char *perm) {
+  if (!strcmp(perm, "rw")) {
+    return RDWR;
+  }
+  if (!strcmp(perm, "r")) {
+    return RDONLY;
+  }
+  if (!strcmp(perm, "w")) {
+    return WRONLY;
+  }
+
+  return -EINVAL;
+}
+
+static u32 pcdev_random(void) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 1, 0)
+  return get_random_u32();
+#else
+  /*only picks sizes, prandom is good enough*/
+  return prandom_u32();
+#endif
+}
+
+static int pcdev_size(unsigned int i) {
+  u32 lo = sizes[0], hi = (nr_sizes > 1) ? sizes[1] : sizes[0];
+  int lo_shift, hi_shift;
+
+  if (!strcmp(size_dist, "uniform")) {
+    return lo + pcdev_random() % (hi - lo + 1);
+  }
+  if (!strcmp(size_dist, "log")) {
+    /*many small devices and a few large ones, the powers of two between
+     * lo and hi, init made sure there is one*/
+    lo_shift = ilog2(roundup_pow_of_two(lo));
+    hi_shift = ilog2(hi);
+    return 1 << (lo_shift + pcdev_random() % (hi_shift - lo_shift + 1));
+  }
+
+  return sizes[i % nr_sizes];
+}
+
+static void pcdev_unregister_all(void) {
+  unsigned int i;
+
+  for (i = 0; i < nr_pcdevs; i++) {
+    platform_device_unregister(pcdevs[i]);
+  }
+  for (i = 0; serials && (i < count); i++) {
+    kfree(serials[i]);
+  }
+  kfree(serials);
+  kfree(pcdevs);
+}
 
 static int __init pcdev_platform_init(void) {
-  /*Register platform device*/
-  platform_add_devices(platform_pcdevs, ARRAY_SIZE(platform_pcdevs));
-  pr_info("Device setup module loaded\n");
+  struct pcdev_platform_data pdata = {0};
+  struct platform_device_info info = {
+      .data = &pdata, .size_data = sizeof(pdata)};
+  struct sysinfo before, after;
+  long used;
+  unsigned int i;
+  ktime_t start;
+  s64 us;
+  int ret;
+
+  /*sizes[0] and sizes[1] bound the random distributions*/
+  if (!count || !nr_sizes || !sizes[0] || !nr_perms || !nr_names ||
+      (sizes[0] > ((nr_sizes > 1) ? sizes[1] : sizes[0])) ||
+      (sizes[(nr_sizes > 1) ? 1 : 0] > INT_MAX)) {
+    pr_err("bad parameters\n");
+    return -EINVAL;
+  }
+  if (strcmp(size_dist, "cycle") && strcmp(size_dist, "uniform") &&
+      strcmp(size_dist, "log")) {
+    pr_err("unknown size_dist %s\n", size_dist);
+    return -EINVAL;
+  }
+  if (!strcmp(size_dist, "log") &&
+      (roundup_pow_of_two(sizes[0]) > sizes[(nr_sizes > 1) ? 1 : 0])) {
+    pr_err("no power of two between sizes[0] and sizes[1]\n");
+    return -EINVAL;
+  }
+  for (i = 0; i < nr_perms; i++) {
+    if (pcdev_parse_perm(perms[i]) < 0) {
+      pr_err("unknown perm %s\n", perms[i]);
+      return -EINVAL;
+    }
+  }
+
+  pcdevs = kcalloc(count, sizeof(*pcdevs), GFP_KERNEL);
+  serials = kcalloc(count, sizeof(*serials), GFP_KERNEL);
+  if (!pcdevs || !serials) {
+    ret = -ENOMEM;
+    goto err;
+  }
+
+  /*the drivers keep pointing at the serial numbers, the rest is copied*/
+  for (i = 0; i < count; i++) {
+    serials[i] = kasprintf(GFP_KERNEL, "PCDEV_SR_%u", i + 1);
+    if (!serials[i]) {
+      ret = -ENOMEM;
+      goto err;
+    }
+  }
+
+  /*with the driver loaded this includes probing every device*/
+  si_meminfo(&before);
+  start = ktime_get();
+  for (i = 0; i < count; i++) {
+    pdata.size = pcdev_size(i);
+    pdata.perm = pcdev_parse_perm(perms[i % nr_perms]);
+    pdata.serial_number = serials[i];
+    pdata.storage = storage;
+    info.name = names[i % nr_names];
+    info.id = i;
+
+    pcdevs[i] = platform_device_register_full(&info);
+    if (IS_ERR(pcdevs[i])) {
+      ret = PTR_ERR(pcdevs[i]);
+      pr_err("cannot register device %u\n", i);
+      goto err;
+    }
+    nr_pcdevs++;
+  }
+  us = ktime_us_delta(ktime_get(), start);
+  si_meminfo(&after);
+
+  /*free memory is system wide, only a rough figure on a busy system*/
+  used = (long)(before.freeram - after.freeram) * (long)PAGE_SIZE;
+  pr_info("registered %u devices in %lld us, %lld ns and about %ld bytes "
+          "per device\n",
+          count, us, div_s64(us * 1000, count), used / (long)count);
   return 0;
+
+err:
+  pcdev_unregister_all();
+  return ret;
 }
 
 static void __exit pcdev_platform_exit(void) {
-  platform_device_unregister(&platform_pcdev_1);
-  platform_device_unregister(&platform_pcdev_2);
-  platform_device_unregister(&platform_pcdev_3);
-  platform_device_unregister(&platform_pcdev_4);
-  pr_info("Device setup module unloaded\n");
+  ktime_t start = ktime_get();
+
+  /*with the driver loaded this includes removing every device*/
+  pcdev_unregister_all();
+  pr_info("unregistered %u devices in %lld us\n", nr_pcdevs,
+          ktime_us_delta(ktime_get(), start));
 }
 
 module_init(pcdev_platform_init);
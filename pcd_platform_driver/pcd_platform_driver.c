@@ -3,11 +3,16 @@
 #include <linux/device.h>
 #include <linux/fs.h>
 #include <linux/kdev_t.h>
+#include <linux/ktime.h>
 #include <linux/mod_devicetable.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/platform_device.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
+#include <linux/version.h>
+
+#include "pcd_core.h"
 
 #undef pr_fmt
 #define pr_fmt(fmt) "%s :" fmt, __func__
@@ -36,14 +41,18 @@ struct platform_device_id pcdevs_ids[] = {
     [1] = {.name = "pcdev-B1X", .driver_data = PCDEVB1X},
     [2] = {.name = "pcdev-C1X", .driver_data = PCDEVC1X},
     [3] = {.name = "pcdev-D1X", .driver_data = PCDEVD1X},
+    {} /*Null termination*/
 };
 
 /*Device private data structure*/
 struct pcdev_private_data {
   struct pcdev_platform_data pdata;
-  char *buffer;
+  /*device memory, on the pcd_core backend the platform data names*/
+  struct pcd_storage storage;
   dev_t dev_num;
   struct cdev cdev;
+  /*serializes accesses to the device memory*/
+  struct mutex lock;
 };
 
 /*Driver private data structure*/
@@ -56,45 +65,94 @@ struct pcdrv_private_data {
 
 struct pcdrv_private_data pcdrv_data;
 
-int check_permission(int dev_perm, int acc_mode) {
-  if (dev_perm == RDWR) {
-    return 0;
-  }
+/*one minor per device id, pcd_device_setup can generate thousands*/
+static unsigned int max_devices = 10;
+module_param(max_devices, uint, 0444);
+MODULE_PARM_DESC(max_devices, "number of device numbers to reserve");
 
-  // Ensure read only actions
-  if ((dev_perm == RDONLY) &&
-      ((acc_mode & FMODE_READ) && !(acc_mode & FMODE_WRITE))) {
-    return 0;
-  }
+/*no printk on the data path, it runs for every read and write*/
+loff_t pcd_llseek(struct file *filep, loff_t offset, int whence) {
+  struct pcdev_private_data *dev_data = filep->private_data;
+
+  return pcd_core_llseek(filep, offset, whence, dev_data->pdata.size);
+}
 
-  // Ensure write only actions
-  if ((dev_perm == WRONLY) &&
-      ((acc_mode & FMODE_WRITE) && !(acc_mode & FMODE_READ))) {
+ssize_t pcd_read(struct file *filep, char __user *buff, size_t count,
+                 loff_t *f_pos) {
+  struct pcdev_private_data *dev_data = filep->private_data;
+  ssize_t ret;
+
+  /* Adjust the count, pread can start past the end*/
+  count = pcd_core_clamp(*f_pos, count, dev_data->pdata.size);
+  if (!count) {
     return 0;
   }
 
-  return -EPERM;
-}
+  /*copy to user */
+  if (mutex_lock_interruptible(&dev_data->lock)) {
+    return -ERESTARTSYS;
+  }
+  ret = pcd_storage_read(&dev_data->storage, buff, count, *f_pos);
+  mutex_unlock(&dev_data->lock);
+  if (ret < 0) {
+    return ret;
+  }
 
-loff_t pcd_llseek(struct file *filep, loff_t offset, int whence) { return 0; }
+  /*update the current file position*/
+  *f_pos += ret;
 
-ssize_t pcd_read(struct file *filep, char __user *buff, size_t count,
-                 loff_t *f_pos) {
-  return 0;
+  return ret;
 }
 
 ssize_t pcd_write(struct file *filep, const char __user *buff, size_t count,
                   loff_t *f_pos) {
-  return -ENOMEM;
+  struct pcdev_private_data *dev_data = filep->private_data;
+  ssize_t ret;
+
+  /* Adjust the count, pwrite can start past the end*/
+  ret = pcd_core_write_count(*f_pos, count, dev_data->pdata.size);
+  if (ret <= 0) {
+    return ret;
+  }
+  count = ret;
+
+  /*copy from user */
+  if (mutex_lock_interruptible(&dev_data->lock)) {
+    return -ERESTARTSYS;
+  }
+  ret = pcd_storage_write(&dev_data->storage, buff, count, *f_pos);
+  mutex_unlock(&dev_data->lock);
+  if (ret < 0) {
+    return ret;
+  }
+
+  /*update the current file position*/
+  *f_pos += ret;
+
+  return ret;
 }
 
-int pcd_open(struct inode *inode, struct file *filep) { return 0; }
+int pcd_open(struct inode *inode, struct file *filep) {
+  struct pcdev_private_data *dev_data;
+  int ret;
+
+  /*get device's private data structure*/
+  dev_data = container_of(inode->i_cdev, struct pcdev_private_data, cdev);
+
+  /*check permission*/
+  ret = pcd_core_check_permission(dev_data->pdata.perm, filep->f_mode);
+  if (ret) {
+    return ret;
+  }
+
+  /*to supply device private data to other methods of the driver*/
+  filep->private_data = dev_data;
 
-int pcd_release(struct inode *inode, struct file *filep) {
-  pr_info("release was successful\n");
   return 0;
 }
 
+int pcd_release(struct inode *inode, struct file *filep) { return 0; }
+
 /*file ops of the driver*/
 struct file_operations pcd_fops = {.open = pcd_open,
                                    .write = pcd_write,
@@ -109,41 +167,50 @@ int pcd_platform_driver_probe(struct platform_device *pdev) {
   struct pcdev_private_data *dev_data;
   struct pcdev_platform_data *pdata;
 
-  pr_info("A device is detected\n");
+  /*probe logs are debug only, loads of devices are probed at once*/
+  dev_dbg(&pdev->dev, "A device is detected\n");
 
   /*Get the platform data*/
   pdata = (struct pcdev_platform_data *)dev_get_platdata(&pdev->dev);
   if (!pdata) {
-    pr_err("no platform info available\n");
+    dev_err(&pdev->dev, "no platform info available\n");
     return -EINVAL;
   }
 
+  if ((pdev->id < 0) || ((unsigned int)pdev->id >= max_devices)) {
+    dev_err(&pdev->dev, "id %d is past max_devices\n", pdev->id);
+    return -ENOSPC;
+  }
+
   /*Dynamically allocate memory for the device private data*/
   dev_data = devm_kzalloc(&pdev->dev, sizeof(*dev_data), GFP_KERNEL);
   if (!dev_data) {
-    pr_err("cannot allocate memory for device\n");
+    dev_err(&pdev->dev, "cannot allocate memory for device\n");
     return -ENOMEM;
   }
 
   dev_data->pdata.size = pdata->size;
   dev_data->pdata.perm = pdata->perm;
   dev_data->pdata.serial_number = pdata->serial_number;
+  dev_data->pdata.storage = pdata->storage;
+  mutex_init(&dev_data->lock);
 
-  pr_info("Device serial number = %s\n", dev_data->pdata.serial_number);
-  pr_info("Device size = %d\n", dev_data->pdata.size);
-  pr_info("Device permission =  %d\n", dev_data->pdata.perm);
+  dev_dbg(&pdev->dev, "Device serial number = %s\n",
+          dev_data->pdata.serial_number);
+  dev_dbg(&pdev->dev, "Device size = %d\n", dev_data->pdata.size);
+  dev_dbg(&pdev->dev, "Device permission =  %d\n", dev_data->pdata.perm);
 
-  pr_info("config item 1 = %d \n",
+  dev_dbg(&pdev->dev, "config item 1 = %d \n",
           pcdev_config[pdev->id_entry->driver_data].config_item1);
-  pr_info("config item 2 = %d \n",
+  dev_dbg(&pdev->dev, "config item 2 = %d \n",
           pcdev_config[pdev->id_entry->driver_data].config_item2);
 
-  /*Dynamically allocate memory for the device buffer using size
-  information from the platform data*/
-  dev_data->buffer = devm_kzalloc(&pdev->dev, dev_data->pdata.size, GFP_KERNEL);
-  if (!(dev_data->buffer)) {
-    pr_err("cannot allocate memory for device buffer\n");
-    return -ENOMEM;
+  /*device memory on the backend the platform data asks for*/
+  ret = pcd_storage_init(&dev_data->storage, dev_data->pdata.storage,
+                         dev_data->pdata.size);
+  if (ret) {
+    dev_err(&pdev->dev, "cannot set up device storage\n");
+    return ret;
   }
 
   /*Save the device private data pointer in platform device structure*/
@@ -158,8 +225,8 @@ int pcd_platform_driver_probe(struct platform_device *pdev) {
   dev_data->cdev.owner = THIS_MODULE;
   ret = cdev_add(&dev_data->cdev, dev_data->dev_num, 1);
   if (ret < 0) {
-    pr_err("cannot add character device");
-    return ret;
+    dev_err(&pdev->dev, "cannot add character device\n");
+    goto free_storage;
   }
 
   /*Create device file for the detected platform device*/
@@ -167,14 +234,20 @@ int pcd_platform_driver_probe(struct platform_device *pdev) {
       device_create(pcdrv_data.class_pcd, NULL, dev_data->dev_num, NULL,
                     "pcdev-%d", pdev->id);
   if (IS_ERR(pcdrv_data.device_pcd)) {
-    pr_err("device create failed");
+    dev_err(&pdev->dev, "device create failed\n");
     ret = PTR_ERR(pcdrv_data.device_pcd);
-    cdev_del(&dev_data->cdev);
+    goto cdev_del;
   }
 
   pcdrv_data.total_devices++;
-  pr_info("The probe was successful\n");
+  dev_dbg(&pdev->dev, "The probe was successful\n");
   return 0;
+
+cdev_del:
+  cdev_del(&dev_data->cdev);
+free_storage:
+  pcd_storage_free(&dev_data->storage);
+  return ret;
 }
 
 /*Called when device is removed from the system*/
@@ -186,61 +259,84 @@ int pcd_platform_driver_remove(struct platform_device *pdev) {
   /*Remove a cdev entry from the system*/
   cdev_del(&dev_data->cdev);
 
+  pcd_storage_free(&dev_data->storage);
+
   pcdrv_data.total_devices--;
-  pr_info("A device is removed\n");
+  dev_dbg(&pdev->dev, "A device is removed\n");
   return 0;
 }
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 11, 0)
+/*remove returns void since 6.11*/
+static void pcd_platform_driver_remove_void(struct platform_device *pdev) {
+  pcd_platform_driver_remove(pdev);
+}
+#define PCD_REMOVE pcd_platform_driver_remove_void
+#else
+#define PCD_REMOVE pcd_platform_driver_remove
+#endif
+
 struct platform_driver pcd_platform_driver = {
     .probe = pcd_platform_driver_probe,
-    .remove = pcd_platform_driver_remove,
+    .remove = PCD_REMOVE,
     .id_table = pcdevs_ids,
     .driver = {.name = "pseudo-char-device"}};
 
-#define MAX_DEVICES 10
-
 static int __init pcd_driver_init(void) {
+  ktime_t start;
   int ret = 0;
-  /*Dynamically allocate a device number for MAX_DEVICE*/
-  ret = alloc_chrdev_region(&pcdrv_data.device_num_base, 0, MAX_DEVICES,
+
+  /*Dynamically allocate a device number for max_devices*/
+  ret = alloc_chrdev_region(&pcdrv_data.device_num_base, 0, max_devices,
                             "pcdevs");
   if (ret < 0) {
     pr_err("alloc chrdev failed\n");
     return ret;
   }
 
-  /*Create device class under /sys/class*/
-  /*NOTE: If kernel version < 6.4  add THIS_MODULE as the first param to the
-   * class_create*/
+  /*Create device class under /sys/class, class_create lost its owner
+   * parameter in 6.4*/
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
   pcdrv_data.class_pcd = class_create("pcd_class");
+#else
+  pcdrv_data.class_pcd = class_create(THIS_MODULE, "pcd_class");
+#endif
   if (IS_ERR(pcdrv_data.class_pcd)) {
     pr_err("class creation failed\n");
     ret = PTR_ERR(pcdrv_data.class_pcd);
-    unregister_chrdev_region(pcdrv_data.device_num_base, MAX_DEVICES);
+    unregister_chrdev_region(pcdrv_data.device_num_base, max_devices);
     return ret;
   }
 
-  /*Register a platform driver*/
+  /*Register a platform driver, this probes the devices already registered*/
+  start = ktime_get();
   ret = platform_driver_register(&pcd_platform_driver);
   if (ret < 0) {
     pr_info("pcd platform driver failed to load\n");
-    unregister_chrdev_region(pcdrv_data.device_num_base, MAX_DEVICES);
     class_destroy(pcdrv_data.class_pcd);
+    unregister_chrdev_region(pcdrv_data.device_num_base, max_devices);
+    return ret;
   }
-  pr_info("pcd platform driver loaded\n");
+  pr_info("pcd platform driver loaded, probed %d devices in %lld us\n",
+          pcdrv_data.total_devices, ktime_us_delta(ktime_get(), start));
 
   return 0;
 }
 
 static void __exit pcd_driver_cleanup(void) {
-  /*Unregister the platform driver*/
+  int total = pcdrv_data.total_devices;
+  ktime_t start = ktime_get();
+
+  /*Unregister the platform driver, this removes every device*/
   platform_driver_unregister(&pcd_platform_driver);
+  pr_info("removed %d devices in %lld us\n", total,
+          ktime_us_delta(ktime_get(), start));
 
   /*Class destroy*/
   class_destroy(pcdrv_data.class_pcd);
 
-  /*Unregister device numbers for MAX_DEVICES*/
-  unregister_chrdev_region(pcdrv_data.device_num_base, MAX_DEVICES);
+  /*Unregister device numbers for max_devices*/
+  unregister_chrdev_region(pcdrv_data.device_num_base, max_devices);
 
   pr_info("pcd platform driver unloaded\n");
 }
@@ -5,6 +5,12 @@ struct pcdev_platform_data {
   int size;
   int perm;
   const char *serial_number;
+  /*compression algorithm, NULL keeps the device uncompressed*/
+  const char *compress;
+  /*largest size max_size can be set to, 0 for size*/
+  int max_size;
+  /*pcd_core storage backend, NULL for the default*/
+  const char *storage;
 };
 
 #define RDWR 0x11
@@ -2,14 +2,19 @@
 #include <linux/cdev.h>
 #include <linux/device.h>
 #include <linux/fs.h>
+#include <linux/idr.h>
 #include <linux/kdev_t.h>
 #include <linux/mod_devicetable.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/of.h>
 #include <linux/of_device.h>
 #include <linux/platform_device.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
+#include <linux/version.h>
+
+#include "pcd_core.h"
 
 #undef pr_fmt
 #define pr_fmt(fmt) "%s :" fmt, __func__
@@ -54,9 +59,19 @@ struct of_device_id org_pcdev_dt_match[] = {
 int pcd_platform_driver_probe(struct platform_device *pdev);
 int pcd_platform_driver_remove(struct platform_device *pdev);
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 11, 0)
+/*remove returns void since 6.11*/
+static void pcd_platform_driver_remove_void(struct platform_device *pdev) {
+  pcd_platform_driver_remove(pdev);
+}
+#define PCD_REMOVE pcd_platform_driver_remove_void
+#else
+#define PCD_REMOVE pcd_platform_driver_remove
+#endif
+
 struct platform_driver pcd_platform_driver = {
     .probe = pcd_platform_driver_probe,
-    .remove = pcd_platform_driver_remove,
+    .remove = PCD_REMOVE,
     .id_table = pcdevs_ids,
     .driver = {.name = "pseudo-char-device",
                .of_match_table = org_pcdev_dt_match}};
@@ -64,9 +79,12 @@ struct platform_driver pcd_platform_driver = {
 /*Device private data structure*/
 struct pcdev_private_data {
   struct pcdev_platform_data pdata;
-  char *buffer;
+  /*device memory, on the pcd_core backend the platform data names*/
+  struct pcd_storage storage;
   dev_t dev_num;
   struct cdev cdev;
+  /*serializes accesses to the device memory*/
+  struct mutex lock;
 };
 
 /*Driver private data structure*/
@@ -79,45 +97,95 @@ struct pcdrv_private_data {
 
 struct pcdrv_private_data pcdrv_data;
 
-int check_permission(int dev_perm, int acc_mode) {
-  if (dev_perm == RDWR) {
-    return 0;
-  }
+/*devices from the device tree have no id, minors come from an IDA*/
+static DEFINE_IDA(pcd_minors);
+static unsigned int max_devices = 10;
+module_param(max_devices, uint, 0444);
+MODULE_PARM_DESC(max_devices, "number of device numbers to reserve");
 
-  // Ensure read only actions
-  if ((dev_perm == RDONLY) &&
-      ((acc_mode & FMODE_READ) && !(acc_mode & FMODE_WRITE))) {
-    return 0;
-  }
+/*no printk on the data path, it runs for every read and write*/
+loff_t pcd_llseek(struct file *filep, loff_t offset, int whence) {
+  struct pcdev_private_data *dev_data = filep->private_data;
 
-  // Ensure write only actions
-  if ((dev_perm == WRONLY) &&
-      ((acc_mode & FMODE_WRITE) && !(acc_mode & FMODE_READ))) {
+  return pcd_core_llseek(filep, offset, whence, dev_data->pdata.size);
+}
+
+ssize_t pcd_read(struct file *filep, char __user *buff, size_t count,
+                 loff_t *f_pos) {
+  struct pcdev_private_data *dev_data = filep->private_data;
+  ssize_t ret;
+
+  /* Adjust the count, pread can start past the end*/
+  count = pcd_core_clamp(*f_pos, count, dev_data->pdata.size);
+  if (!count) {
     return 0;
   }
 
-  return -EPERM;
-}
+  /*copy to user */
+  if (mutex_lock_interruptible(&dev_data->lock)) {
+    return -ERESTARTSYS;
+  }
+  ret = pcd_storage_read(&dev_data->storage, buff, count, *f_pos);
+  mutex_unlock(&dev_data->lock);
+  if (ret < 0) {
+    return ret;
+  }
 
-loff_t pcd_llseek(struct file *filep, loff_t offset, int whence) { return 0; }
+  /*update the current file position*/
+  *f_pos += ret;
 
-ssize_t pcd_read(struct file *filep, char __user *buff, size_t count,
-                 loff_t *f_pos) {
-  return 0;
+  return ret;
 }
 
 ssize_t pcd_write(struct file *filep, const char __user *buff, size_t count,
                   loff_t *f_pos) {
-  return -ENOMEM;
+  struct pcdev_private_data *dev_data = filep->private_data;
+  ssize_t ret;
+
+  /* Adjust the count, pwrite can start past the end*/
+  ret = pcd_core_write_count(*f_pos, count, dev_data->pdata.size);
+  if (ret <= 0) {
+    return ret;
+  }
+  count = ret;
+
+  /*copy from user */
+  if (mutex_lock_interruptible(&dev_data->lock)) {
+    return -ERESTARTSYS;
+  }
+  ret = pcd_storage_write(&dev_data->storage, buff, count, *f_pos);
+  mutex_unlock(&dev_data->lock);
+  if (ret < 0) {
+    return ret;
+  }
+
+  /*update the current file position*/
+  *f_pos += ret;
+
+  return ret;
 }
 
-int pcd_open(struct inode *inode, struct file *filep) { return 0; }
+int pcd_open(struct inode *inode, struct file *filep) {
+  struct pcdev_private_data *dev_data;
+  int ret;
+
+  /*get device's private data structure*/
+  dev_data = container_of(inode->i_cdev, struct pcdev_private_data, cdev);
+
+  /*check permission*/
+  ret = pcd_core_check_permission(dev_data->pdata.perm, filep->f_mode);
+  if (ret) {
+    return ret;
+  }
+
+  /*to supply device private data to other methods of the driver*/
+  filep->private_data = dev_data;
 
-int pcd_release(struct inode *inode, struct file *filep) {
-  pr_info("release was successful\n");
   return 0;
 }
 
+int pcd_release(struct inode *inode, struct file *filep) { return 0; }
+
 /*file ops of the driver*/
 struct file_operations pcd_fops = {.open = pcd_open,
                                    .write = pcd_write,
@@ -159,6 +227,9 @@ pcdev_get_platform_data_from_dt(struct device *dev) {
     return ERR_PTR(-EINVAL);
   }
 
+  /*optional, the default pcd_core backend without it*/
+  of_property_read_string(dev_node, "org,storage", &pdata->storage);
+
   return pdata;
 }
 
@@ -170,6 +241,7 @@ int pcd_platform_driver_probe(struct platform_device *pdev) {
   struct pcdev_platform_data *pdata = {0};
   struct device *dev = &pdev->dev;
   int driver_data = 0;
+  int minor;
 
   dev_info(dev, "A device is detected\n");
 
@@ -188,7 +260,7 @@ int pcd_platform_driver_probe(struct platform_device *pdev) {
     }
     driver_data = pdev->id_entry->driver_data;
   } else {
-    driver_data = (int)of_device_get_match_data(dev);
+    driver_data = (long)of_device_get_match_data(dev);
   }
   /*Dynamically allocate memory for the device private data*/
   dev_data = devm_kzalloc(dev, sizeof(*dev_data), GFP_KERNEL);
@@ -200,6 +272,8 @@ int pcd_platform_driver_probe(struct platform_device *pdev) {
   dev_data->pdata.size = pdata->size;
   dev_data->pdata.perm = pdata->perm;
   dev_data->pdata.serial_number = pdata->serial_number;
+  dev_data->pdata.storage = pdata->storage;
+  mutex_init(&dev_data->lock);
 
   pr_info("Device serial number = %s\n", dev_data->pdata.serial_number);
   pr_info("Device size = %d\n", dev_data->pdata.size);
@@ -208,19 +282,25 @@ int pcd_platform_driver_probe(struct platform_device *pdev) {
   pr_info("config item 1 = %d \n", pcdev_config[driver_data].config_item1);
   pr_info("config item 2 = %d \n", pcdev_config[driver_data].config_item2);
 
-  /*Dynamically allocate memory for the device buffer using size
-  information from the platform data*/
-  dev_data->buffer = devm_kzalloc(dev, dev_data->pdata.size, GFP_KERNEL);
-  if (!(dev_data->buffer)) {
-    dev_err(dev, "cannot allocate memory for device buffer\n");
-    return -ENOMEM;
+  /*device memory on the backend the platform data asks for*/
+  ret = pcd_storage_init(&dev_data->storage, dev_data->pdata.storage,
+                         dev_data->pdata.size);
+  if (ret) {
+    dev_err(dev, "cannot set up device storage\n");
+    return ret;
   }
 
   /*Save the device private data pointer in platform device structure*/
   dev_set_drvdata(dev, dev_data);
 
-  /*Get the device number*/
-  dev_data->dev_num = pcdrv_data.device_num_base + pcdrv_data.total_devices;
+  /*Get the device number, the lowest minor no other device holds*/
+  minor = ida_alloc_max(&pcd_minors, max_devices - 1, GFP_KERNEL);
+  if (minor < 0) {
+    dev_err(dev, "no device number left, max_devices is %u\n", max_devices);
+    ret = minor;
+    goto free_storage;
+  }
+  dev_data->dev_num = pcdrv_data.device_num_base + minor;
 
   /*Do cdev init and cdev add*/
   cdev_init(&dev_data->cdev, &pcd_fops);
@@ -229,22 +309,30 @@ int pcd_platform_driver_probe(struct platform_device *pdev) {
   ret = cdev_add(&dev_data->cdev, dev_data->dev_num, 1);
   if (ret < 0) {
     dev_err(dev, "cannot add character device");
-    return ret;
+    goto free_minor;
   }
 
   /*Create device file for the detected platform device*/
   pcdrv_data.device_pcd =
       device_create(pcdrv_data.class_pcd, dev, dev_data->dev_num, NULL,
-                    "pcdev-%d", pcdrv_data.total_devices);
+                    "pcdev-%d", minor);
   if (IS_ERR(pcdrv_data.device_pcd)) {
     dev_err(dev, "device create failed");
     ret = PTR_ERR(pcdrv_data.device_pcd);
-    cdev_del(&dev_data->cdev);
+    goto cdev_del;
   }
 
   pcdrv_data.total_devices++;
   dev_info(dev, "The probe was successful\n");
   return 0;
+
+cdev_del:
+  cdev_del(&dev_data->cdev);
+free_minor:
+  ida_free(&pcd_minors, minor);
+free_storage:
+  pcd_storage_free(&dev_data->storage);
+  return ret;
 }
 
 /*Called when device is removed from the system*/
@@ -256,32 +344,42 @@ int pcd_platform_driver_remove(struct platform_device *pdev) {
 
   /*Remove a cdev entry from the system*/
   cdev_del(&dev_data->cdev);
+  ida_free(&pcd_minors, dev_data->dev_num - pcdrv_data.device_num_base);
+
+  pcd_storage_free(&dev_data->storage);
 
   pcdrv_data.total_devices--;
   dev_info(dev, "A device is removed\n");
   return 0;
 }
 
-#define MAX_DEVICES 10
-
 static int __init pcd_driver_init(void) {
   int ret = 0;
-  /*Dynamically allocate a device number for MAX_DEVICE*/
-  ret = alloc_chrdev_region(&pcdrv_data.device_num_base, 0, MAX_DEVICES,
+
+  if (!max_devices || (max_devices > MINORMASK + 1)) {
+    pr_err("max_devices must be between 1 and %u\n", MINORMASK + 1);
+    return -EINVAL;
+  }
+
+  /*Dynamically allocate a device number for max_devices*/
+  ret = alloc_chrdev_region(&pcdrv_data.device_num_base, 0, max_devices,
                             "pcdevs");
   if (ret < 0) {
     pr_err("alloc chrdev failed\n");
     return ret;
   }
 
-  /*Create device class under /sys/class*/
-  /*NOTE: If kernel version < 6.4  add THIS_MODULE as the first param to the
-   * class_create*/
+  /*Create device class under /sys/class, class_create lost its owner
+   * parameter in 6.4*/
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+  pcdrv_data.class_pcd = class_create("pcd_class");
+#else
   pcdrv_data.class_pcd = class_create(THIS_MODULE, "pcd_class");
+#endif
   if (IS_ERR(pcdrv_data.class_pcd)) {
     pr_err("class creation failed\n");
     ret = PTR_ERR(pcdrv_data.class_pcd);
-    unregister_chrdev_region(pcdrv_data.device_num_base, MAX_DEVICES);
+    unregister_chrdev_region(pcdrv_data.device_num_base, max_devices);
     return ret;
   }
 
@@ -289,7 +387,7 @@ static int __init pcd_driver_init(void) {
   ret = platform_driver_register(&pcd_platform_driver);
   if (ret < 0) {
     pr_info("pcd platform driver failed to load\n");
-    unregister_chrdev_region(pcdrv_data.device_num_base, MAX_DEVICES);
+    unregister_chrdev_region(pcdrv_data.device_num_base, max_devices);
     class_destroy(pcdrv_data.class_pcd);
   }
   pr_info("pcd platform driver loaded\n");
@@ -304,8 +402,10 @@ static void __exit pcd_driver_cleanup(void) {
   /*Class destroy*/
   class_destroy(pcdrv_data.class_pcd);
 
-  /*Unregister device numbers for MAX_DEVICES*/
-  unregister_chrdev_region(pcdrv_data.device_num_base, MAX_DEVICES);
+  ida_destroy(&pcd_minors);
+
+  /*Unregister device numbers for max_devices*/
+  unregister_chrdev_region(pcdrv_data.device_num_base, max_devices);
 
   pr_info("pcd platform driver unloaded\n");
 }
@@ -5,6 +5,12 @@ struct pcdev_platform_data {
   int size;
   int perm;
   const char *serial_number;
+  /*only pcd_sysfs uses compress and max_size, they keep the layout
+   * pcd_device_setup fills in*/
+  const char *compress;
+  int max_size;
+  /*pcd_core storage backend, NULL for the default*/
+  const char *storage;
 };
 
 #define RDWR 0x11
@@ -0,0 +1,322 @@
+#include <linux/ktime.h>
+#include <linux/lz4.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+#include <linux/zstd.h>
+
+#include "pcd_platform_driver_device_tree_sysfs.h"
+
+/*
+ * Compressed device memory. Every page is kept as its own compressed object,
+ * kmalloc'ed at the compressed size so the slab size classes pack them the
+ * way zsmalloc would. All-zero pages take no memory. The last few pages
+ * touched are kept uncompressed in a small hot cache and are compressed
+ * again when they get evicted.
+ */
+
+#define PCD_ZSTD_LEVEL 1
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 16, 0)
+/*the zstd_ wrappers came with zstd 1.4.10 in 5.16, the board kernel only
+ * has the original ZSTD_ calls, which take the parameters by value*/
+typedef ZSTD_parameters zstd_parameters;
+#define zstd_get_params(level, size) ZSTD_getParams(level, size, 0)
+#define zstd_cctx_workspace_bound(cparams) ZSTD_CCtxWorkspaceBound(*(cparams))
+#define zstd_dctx_workspace_bound() ZSTD_DCtxWorkspaceBound()
+#define zstd_init_cctx(wrk, size) ZSTD_initCCtx(wrk, size)
+#define zstd_init_dctx(wrk, size) ZSTD_initDCtx(wrk, size)
+#define zstd_compress_cctx(cctx, dst, cap, src, size, params)                  \
+  ZSTD_compressCCtx(cctx, dst, cap, src, size, *(params))
+#define zstd_decompress_dctx(dctx, dst, cap, src, size)                        \
+  ZSTD_decompressDCtx(dctx, dst, cap, src, size)
+#define zstd_is_error(code) ZSTD_isError(code)
+#endif
+
+static int pcd_lz4_init(struct pcd_zstore *zs) {
+  zs->cwrk = kvmalloc(LZ4_MEM_COMPRESS, GFP_KERNEL);
+  return zs->cwrk ? 0 : -ENOMEM;
+}
+
+/*0 means the page did not shrink and is stored as is*/
+static size_t pcd_lz4_compress(struct pcd_zstore *zs, const void *src,
+                               void *dst) {
+  int len;
+
+  len = LZ4_compress_default(src, dst, PAGE_SIZE, PAGE_SIZE - 1, zs->cwrk);
+  return len > 0 ? len : 0;
+}
+
+static int pcd_lz4_decompress(struct pcd_zstore *zs, const void *src,
+                              size_t len, void *dst) {
+  return LZ4_decompress_safe(src, dst, len, PAGE_SIZE) == PAGE_SIZE ? 0
+                                                                    : -EIO;
+}
+
+static int pcd_zstd_init(struct pcd_zstore *zs) {
+  zstd_parameters params = zstd_get_params(PCD_ZSTD_LEVEL, PAGE_SIZE);
+  size_t csize = zstd_cctx_workspace_bound(&params.cParams);
+  size_t dsize = zstd_dctx_workspace_bound();
+
+  zs->cwrk = kvmalloc(csize, GFP_KERNEL);
+  zs->dwrk = kvmalloc(dsize, GFP_KERNEL);
+  if (!zs->cwrk || !zs->dwrk) {
+    return -ENOMEM;
+  }
+
+  zs->cctx = zstd_init_cctx(zs->cwrk, csize);
+  zs->dctx = zstd_init_dctx(zs->dwrk, dsize);
+  if (!zs->cctx || !zs->dctx) {
+    return -EINVAL;
+  }
+
+  return 0;
+}
+
+static size_t pcd_zstd_compress(struct pcd_zstore *zs, const void *src,
+                                void *dst) {
+  zstd_parameters params = zstd_get_params(PCD_ZSTD_LEVEL, PAGE_SIZE);
+  size_t len;
+
+  len = zstd_compress_cctx(zs->cctx, dst, PAGE_SIZE - 1, src, PAGE_SIZE,
+                           &params);
+  return zstd_is_error(len) ? 0 : len;
+}
+
+static int pcd_zstd_decompress(struct pcd_zstore *zs, const void *src,
+                               size_t len, void *dst) {
+  size_t ret;
+
+  ret = zstd_decompress_dctx(zs->dctx, dst, PAGE_SIZE, src, len);
+  return (zstd_is_error(ret) || (ret != PAGE_SIZE)) ? -EIO : 0;
+}
+
+static const struct pcd_codec pcd_codecs[] = {
+    {.name = "lz4",
+     .init = pcd_lz4_init,
+     .compress = pcd_lz4_compress,
+     .decompress = pcd_lz4_decompress},
+    {.name = "zstd",
+     .init = pcd_zstd_init,
+     .compress = pcd_zstd_compress,
+     .decompress = pcd_zstd_decompress},
+};
+
+const struct pcd_codec *pcd_codec_find(const char *name) {
+  int i;
+
+  for (i = 0; i < ARRAY_SIZE(pcd_codecs); i++) {
+    if (!strcmp(pcd_codecs[i].name, name)) {
+      return &pcd_codecs[i];
+    }
+  }
+
+  return NULL;
+}
+
+int pcd_zstore_init(struct pcd_zstore *zs, const struct pcd_codec *codec,
+                    size_t size) {
+  int ret, i;
+
+  memset(zs, 0, sizeof(*zs));
+  zs->codec = codec;
+  zs->nr_pages = DIV_ROUND_UP(size, PAGE_SIZE);
+
+  zs->objs = kvcalloc(zs->nr_pages, sizeof(*zs->objs), GFP_KERNEL);
+  zs->lens = kvcalloc(zs->nr_pages, sizeof(*zs->lens), GFP_KERNEL);
+  zs->scratch = kmalloc(PAGE_SIZE, GFP_KERNEL);
+  if (!zs->objs || !zs->lens || !zs->scratch) {
+    ret = -ENOMEM;
+    goto err;
+  }
+
+  for (i = 0; i < PCD_HOT_PAGES; i++) {
+    zs->hot[i].index = ULONG_MAX;
+    zs->hot[i].data = kmalloc(PAGE_SIZE, GFP_KERNEL);
+    if (!zs->hot[i].data) {
+      ret = -ENOMEM;
+      goto err;
+    }
+  }
+
+  ret = codec->init(zs);
+  if (ret) {
+    goto err;
+  }
+
+  return 0;
+
+err:
+  pcd_zstore_free(zs);
+  return ret;
+}
+
+void pcd_zstore_free(struct pcd_zstore *zs) {
+  unsigned long i;
+
+  if (zs->objs) {
+    for (i = 0; i < zs->nr_pages; i++) {
+      kfree(zs->objs[i]);
+    }
+  }
+  for (i = 0; i < PCD_HOT_PAGES; i++) {
+    kfree(zs->hot[i].data);
+  }
+  kvfree(zs->objs);
+  kvfree(zs->lens);
+  kfree(zs->scratch);
+  kvfree(zs->cwrk);
+  kvfree(zs->dwrk);
+  memset(zs, 0, sizeof(*zs));
+}
+
+/*compress a hot page back into its object*/
+static int pcd_zstore_writeback(struct pcd_zstore *zs, struct pcd_hot *hot) {
+  unsigned long index = hot->index;
+  const void *src;
+  size_t len;
+  void *obj;
+
+  if (!memchr_inv(hot->data, 0, PAGE_SIZE)) {
+    /*zero pages are holes*/
+    kfree(zs->objs[index]);
+    zs->objs[index] = NULL;
+    len = 0;
+  } else {
+    len = zs->codec->compress(zs, hot->data, zs->scratch);
+    src = zs->scratch;
+    if (!len) {
+      len = PAGE_SIZE;
+      src = hot->data;
+    }
+
+    /*krealloc keeps the object in place when it still fits*/
+    obj = krealloc(zs->objs[index], len, GFP_KERNEL);
+    if (!obj) {
+      return -ENOMEM;
+    }
+    memcpy(obj, src, len);
+    zs->objs[index] = obj;
+  }
+
+  zs->stored_bytes += len;
+  zs->stored_bytes -= zs->lens[index];
+  if (len && !zs->lens[index]) {
+    zs->stored_pages++;
+  } else if (!len && zs->lens[index]) {
+    zs->stored_pages--;
+  }
+  zs->lens[index] = len;
+  hot->dirty = false;
+
+  return 0;
+}
+
+static int pcd_zstore_load(struct pcd_zstore *zs, struct pcd_hot *hot,
+                           unsigned long index) {
+  u32 len = zs->lens[index];
+  u64 start;
+  int ret;
+
+  if (!len) {
+    memset(hot->data, 0, PAGE_SIZE);
+  } else if (len == PAGE_SIZE) {
+    memcpy(hot->data, zs->objs[index], PAGE_SIZE);
+  } else {
+    start = ktime_get_ns();
+    ret = zs->codec->decompress(zs, zs->objs[index], len, hot->data);
+    if (ret) {
+      return ret;
+    }
+    zs->decompress_ns += ktime_get_ns() - start;
+    zs->decompressions++;
+  }
+
+  hot->index = index;
+  return 0;
+}
+
+/*uncompressed view of page index, from the hot cache or decompressed into
+ * the least recently used slot*/
+static void *pcd_zstore_page(struct pcd_zstore *zs, unsigned long index,
+                             bool write) {
+  struct pcd_hot *hot, *victim = NULL;
+  int ret, i;
+
+  for (i = 0; i < PCD_HOT_PAGES; i++) {
+    hot = &zs->hot[i];
+    if (hot->index == index) {
+      zs->hot_hits++;
+      goto found;
+    }
+    if (!victim || (hot->used < victim->used)) {
+      victim = hot;
+    }
+  }
+
+  hot = victim;
+  if ((hot->index != ULONG_MAX) && hot->dirty) {
+    ret = pcd_zstore_writeback(zs, hot);
+    if (ret) {
+      return ERR_PTR(ret);
+    }
+  }
+
+  hot->index = ULONG_MAX;
+  ret = pcd_zstore_load(zs, hot, index);
+  if (ret) {
+    return ERR_PTR(ret);
+  }
+
+found:
+  hot->used = ++zs->clock;
+  hot->dirty |= write;
+  return hot->data;
+}
+
+ssize_t pcd_zstore_read(struct pcd_zstore *zs, char __user *buff,
+                        size_t count, loff_t pos) {
+  size_t done = 0, offset, chunk;
+  void *data;
+
+  while (done < count) {
+    offset = offset_in_page(pos);
+    chunk = min_t(size_t, PAGE_SIZE - offset, count - done);
+
+    data = pcd_zstore_page(zs, pos >> PAGE_SHIFT, false);
+    if (IS_ERR(data)) {
+      return PTR_ERR(data);
+    }
+    if (copy_to_user(buff + done, data + offset, chunk)) {
+      return -EFAULT;
+    }
+
+    done += chunk;
+    pos += chunk;
+  }
+
+  return done;
+}
+
+ssize_t pcd_zstore_write(struct pcd_zstore *zs, const char __user *buff,
+                         size_t count, loff_t pos) {
+  size_t done = 0, offset, chunk;
+  void *data;
+
+  while (done < count) {
+    offset = offset_in_page(pos);
+    chunk = min_t(size_t, PAGE_SIZE - offset, count - done);
+
+    data = pcd_zstore_page(zs, pos >> PAGE_SHIFT, true);
+    if (IS_ERR(data)) {
+      return PTR_ERR(data);
+    }
+    if (copy_from_user(data + offset, buff + done, chunk)) {
+      return -EFAULT;
+    }
+
+    done += chunk;
+    pos += chunk;
+  }
+
+  return done;
+}
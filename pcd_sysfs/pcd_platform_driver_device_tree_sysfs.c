@@ -25,12 +25,28 @@ struct device_config pcdev_config[] = {
     [PCDEVD1X] = {.config_item1 = 12, .config_item2 = 120},
 };
 
+/*devices from the device tree have no id, minors come from an IDA*/
+static DEFINE_IDA(pcd_minors);
+static unsigned int max_devices = 10;
+module_param(max_devices, uint, 0444);
+MODULE_PARM_DESC(max_devices, "number of device numbers to reserve");
+
 int pcd_platform_driver_probe(struct platform_device *pdev);
 int pcd_platform_driver_remove(struct platform_device *pdev);
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 11, 0)
+/*remove returns void since 6.11*/
+static void pcd_platform_driver_remove_void(struct platform_device *pdev) {
+  pcd_platform_driver_remove(pdev);
+}
+#define PCD_REMOVE pcd_platform_driver_remove_void
+#else
+#define PCD_REMOVE pcd_platform_driver_remove
+#endif
+
 struct platform_driver pcd_platform_driver = {
     .probe = pcd_platform_driver_probe,
-    .remove = pcd_platform_driver_remove,
+    .remove = PCD_REMOVE,
     .id_table = pcdevs_ids,
     .driver = {.name = "pseudo-char-device",
                .of_match_table = org_pcdev_dt_match}};
@@ -64,20 +80,179 @@ ssize_t store_max_size(struct device *dev, struct device_attribute *attr,
     return ret;
   }
 
+  /*the compressed store is sized once at probe*/
+  if (dev_data->zstore.codec) {
+    return -EBUSY;
+  }
+
+  /*the storage was set up for the largest size at probe, resizing never
+   * allocates and readers are only held up for the assignment*/
+  if ((result <= 0) || (result > dev_data->capacity)) {
+    return -EINVAL;
+  }
+
+  mutex_lock(&dev_data->lock);
   dev_data->pdata.size = result;
+  mutex_unlock(&dev_data->lock);
+
+  return count;
+}
+
+ssize_t show_compression(struct device *dev, struct device_attribute *attr,
+                         char *buf) {
+  struct pcdev_private_data *dev_data = dev_get_drvdata(dev->parent);
+
+  return sprintf(buf, "%s\n",
+                 dev_data->zstore.codec ? dev_data->zstore.codec->name
+                                        : "none");
+}
+
+/*uncompressed size of the stored pages over their compressed size*/
+ssize_t show_compr_ratio(struct device *dev, struct device_attribute *attr,
+                         char *buf) {
+  struct pcdev_private_data *dev_data = dev_get_drvdata(dev->parent);
+  u64 orig, stored, ratio;
+
+  mutex_lock(&dev_data->lock);
+  orig = dev_data->zstore.stored_pages * PAGE_SIZE;
+  stored = dev_data->zstore.stored_bytes;
+  mutex_unlock(&dev_data->lock);
+
+  ratio = stored ? div64_u64(orig * 100, stored) : 100;
+  return sprintf(buf, "%llu.%02llu\n", ratio / 100, ratio % 100);
+}
+
+/*average time one page decompression took*/
+ssize_t show_decompress_latency_ns(struct device *dev,
+                                   struct device_attribute *attr, char *buf) {
+  struct pcdev_private_data *dev_data = dev_get_drvdata(dev->parent);
+  u64 ns, nr;
+
+  mutex_lock(&dev_data->lock);
+  ns = dev_data->zstore.decompress_ns;
+  nr = dev_data->zstore.decompressions;
+  mutex_unlock(&dev_data->lock);
+
+  return sprintf(buf, "%llu\n", nr ? div64_u64(ns, nr) : 0);
+}
+
+/*rate limits, 0 is unlimited*/
+static ssize_t store_qos_limit(struct device *dev, const char *buf,
+                               size_t count, u64 *limit) {
+  struct pcdev_private_data *dev_data = dev_get_drvdata(dev->parent);
+  u64 value;
+  int ret;
+
+  ret = kstrtou64(buf, 10, &value);
+  if (ret) {
+    return ret;
+  }
+
+  pcd_qos_set(&dev_data->qos, limit, value);
+  return count;
+}
+
+#define PCD_QOS_LIMIT_ATTR(name)                                               \
+  static ssize_t show_##name(struct device *dev,                               \
+                             struct device_attribute *attr, char *buf) {       \
+    struct pcdev_private_data *dev_data = dev_get_drvdata(dev->parent);        \
+    return sprintf(buf, "%llu\n", READ_ONCE(dev_data->qos.name));              \
+  }                                                                            \
+  static ssize_t store_##name(struct device *dev,                              \
+                              struct device_attribute *attr, const char *buf,  \
+                              size_t count) {                                  \
+    struct pcdev_private_data *dev_data = dev_get_drvdata(dev->parent);        \
+    return store_qos_limit(dev, buf, count, &dev_data->qos.name);              \
+  }                                                                            \
+  static DEVICE_ATTR(name, S_IRUGO | S_IWUSR, show_##name, store_##name)
+
+PCD_QOS_LIMIT_ATTR(bytes_rate);
+PCD_QOS_LIMIT_ATTR(ops_rate);
+PCD_QOS_LIMIT_ATTR(file_bytes_rate);
+PCD_QOS_LIMIT_ATTR(file_ops_rate);
+
+ssize_t show_burst_ms(struct device *dev, struct device_attribute *attr,
+                      char *buf) {
+  struct pcdev_private_data *dev_data = dev_get_drvdata(dev->parent);
+
+  return sprintf(buf, "%u\n", READ_ONCE(dev_data->qos.burst_ms));
+}
+
+ssize_t store_burst_ms(struct device *dev, struct device_attribute *attr,
+                       const char *buf, size_t count) {
+  struct pcdev_private_data *dev_data = dev_get_drvdata(dev->parent);
+  u32 value;
+  int ret;
+
+  ret = kstrtou32(buf, 10, &value);
+  if (ret) {
+    return ret;
+  }
 
-  dev_data->buffer =
-      krealloc(dev_data->buffer, dev_data->pdata.size, GFP_KERNEL);
+  spin_lock(&dev_data->qos.lock);
+  dev_data->qos.burst_ms = value;
+  spin_unlock(&dev_data->qos.lock);
 
   return count;
 }
 
+/*number of throttled accesses and the total time they waited*/
+ssize_t show_throttled(struct device *dev, struct device_attribute *attr,
+                       char *buf) {
+  struct pcdev_private_data *dev_data = dev_get_drvdata(dev->parent);
+  u64 throttled, wait_ns;
+
+  spin_lock(&dev_data->qos.lock);
+  throttled = dev_data->qos.throttled;
+  wait_ns = dev_data->qos.wait_ns;
+  spin_unlock(&dev_data->qos.lock);
+
+  return sprintf(buf, "%llu %llu\n", throttled, wait_ns);
+}
+
+/*one line per bucket, the wait's upper bound in us and the count*/
+ssize_t show_wait_hist(struct device *dev, struct device_attribute *attr,
+                       char *buf) {
+  struct pcdev_private_data *dev_data = dev_get_drvdata(dev->parent);
+  u64 hist[PCD_QOS_HIST_BUCKETS];
+  int i, len = 0;
+
+  spin_lock(&dev_data->qos.lock);
+  memcpy(hist, dev_data->qos.wait_hist, sizeof(hist));
+  spin_unlock(&dev_data->qos.lock);
+
+  for (i = 0; i < PCD_QOS_HIST_BUCKETS - 1; i++) {
+    len += sysfs_emit_at(buf, len, "%lu %llu\n", 2UL << i, hist[i]);
+  }
+  len += sysfs_emit_at(buf, len, "inf %llu\n", hist[i]);
+
+  return len;
+}
+
 /*Create 2 variables of struct device attribute*/
 static DEVICE_ATTR(max_size, S_IRUGO | S_IWUSR, show_max_size, store_max_size);
 static DEVICE_ATTR(serial_number, S_IRUGO, show_serial_number, NULL);
+static DEVICE_ATTR(compression, S_IRUGO, show_compression, NULL);
+static DEVICE_ATTR(compr_ratio, S_IRUGO, show_compr_ratio, NULL);
+static DEVICE_ATTR(decompress_latency_ns, S_IRUGO, show_decompress_latency_ns,
+                   NULL);
+static DEVICE_ATTR(burst_ms, S_IRUGO | S_IWUSR, show_burst_ms, store_burst_ms);
+static DEVICE_ATTR(throttled, S_IRUGO, show_throttled, NULL);
+static DEVICE_ATTR(wait_hist, S_IRUGO, show_wait_hist, NULL);
 
 struct attribute *pcd_attrs[] = {&dev_attr_max_size.attr,
-                                 &dev_attr_serial_number.attr, NULL};
+                                 &dev_attr_serial_number.attr,
+                                 &dev_attr_compression.attr,
+                                 &dev_attr_compr_ratio.attr,
+                                 &dev_attr_decompress_latency_ns.attr,
+                                 &dev_attr_bytes_rate.attr,
+                                 &dev_attr_ops_rate.attr,
+                                 &dev_attr_file_bytes_rate.attr,
+                                 &dev_attr_file_ops_rate.attr,
+                                 &dev_attr_burst_ms.attr,
+                                 &dev_attr_throttled.attr,
+                                 &dev_attr_wait_hist.attr,
+                                 NULL};
 
 struct attribute_group pcd_attr_group ={
   .attrs = pcd_attrs
@@ -140,6 +315,15 @@ pcdev_get_platform_data_from_dt(struct device *dev) {
     return ERR_PTR(-EINVAL);
   }
 
+  /*optional, the device is uncompressed without it*/
+  of_property_read_string(dev_node, "org,compress", &pdata->compress);
+
+  /*optional, max_size can't grow the device without it*/
+  of_property_read_u32(dev_node, "org,max-size", &pdata->max_size);
+
+  /*optional, the default pcd_core backend without it*/
+  of_property_read_string(dev_node, "org,storage", &pdata->storage);
+
   return pdata;
 }
 
@@ -150,7 +334,9 @@ int pcd_platform_driver_probe(struct platform_device *pdev) {
   struct pcdev_private_data *dev_data = {0};
   struct pcdev_platform_data *pdata = {0};
   struct device *dev = &pdev->dev;
+  const struct pcd_codec *codec;
   int driver_data = 0;
+  int minor;
 
   dev_info(dev, "A device is detected\n");
 
@@ -169,7 +355,7 @@ int pcd_platform_driver_probe(struct platform_device *pdev) {
     }
     driver_data = pdev->id_entry->driver_data;
   } else {
-    driver_data = (int)of_device_get_match_data(dev);
+    driver_data = (long)of_device_get_match_data(dev);
   }
   /*Dynamically allocate memory for the device private data*/
   dev_data = devm_kzalloc(dev, sizeof(*dev_data), GFP_KERNEL);
@@ -181,6 +367,11 @@ int pcd_platform_driver_probe(struct platform_device *pdev) {
   dev_data->pdata.size = pdata->size;
   dev_data->pdata.perm = pdata->perm;
   dev_data->pdata.serial_number = pdata->serial_number;
+  dev_data->pdata.compress = pdata->compress;
+  dev_data->pdata.storage = pdata->storage;
+  dev_data->capacity = max(pdata->size, pdata->max_size);
+  mutex_init(&dev_data->lock);
+  pcd_qos_init(&dev_data->qos);
 
   pr_info("Device serial number = %s\n", dev_data->pdata.serial_number);
   pr_info("Device size = %d\n", dev_data->pdata.size);
@@ -189,19 +380,41 @@ int pcd_platform_driver_probe(struct platform_device *pdev) {
   pr_info("config item 1 = %d \n", pcdev_config[driver_data].config_item1);
   pr_info("config item 2 = %d \n", pcdev_config[driver_data].config_item2);
 
-  /*Dynamically allocate memory for the device buffer using size
-  information from the platform data*/
-  dev_data->buffer = devm_kzalloc(dev, dev_data->pdata.size, GFP_KERNEL);
-  if (!(dev_data->buffer)) {
-    dev_err(dev, "cannot allocate memory for device buffer\n");
-    return -ENOMEM;
+  if (dev_data->pdata.compress) {
+    /*compressed devices keep their pages in a zstore instead of a buffer*/
+    codec = pcd_codec_find(dev_data->pdata.compress);
+    if (!codec) {
+      dev_err(dev, "unknown compression %s\n", dev_data->pdata.compress);
+      return -EINVAL;
+    }
+
+    ret = pcd_zstore_init(&dev_data->zstore, codec, dev_data->pdata.size);
+    if (ret) {
+      dev_err(dev, "cannot set up compressed store\n");
+      return ret;
+    }
+  } else {
+    /*device memory for the largest size, on the backend the platform
+    data asks for*/
+    ret = pcd_storage_init(&dev_data->storage, dev_data->pdata.storage,
+                           dev_data->capacity);
+    if (ret) {
+      dev_err(dev, "cannot set up device storage\n");
+      return ret;
+    }
   }
 
   /*Save the device private data pointer in platform device structure*/
   dev_set_drvdata(dev, dev_data);
 
-  /*Get the device number*/
-  dev_data->dev_num = pcdrv_data.device_num_base + pcdrv_data.total_devices;
+  /*Get the device number, the lowest minor no other device holds*/
+  minor = ida_alloc_max(&pcd_minors, max_devices - 1, GFP_KERNEL);
+  if (minor < 0) {
+    dev_err(dev, "no device number left, max_devices is %u\n", max_devices);
+    ret = minor;
+    goto free_store;
+  }
+  dev_data->dev_num = pcdrv_data.device_num_base + minor;
 
   /*Do cdev init and cdev add*/
   cdev_init(&dev_data->cdev, &pcd_fops);
@@ -210,29 +423,40 @@ int pcd_platform_driver_probe(struct platform_device *pdev) {
   ret = cdev_add(&dev_data->cdev, dev_data->dev_num, 1);
   if (ret < 0) {
     dev_err(dev, "cannot add character device");
-    return ret;
+    goto free_minor;
   }
 
   /*Create device file for the detected platform device*/
   pcdrv_data.device_pcd =
       device_create(pcdrv_data.class_pcd, dev, dev_data->dev_num, NULL,
-                    "pcdev-%d", pcdrv_data.total_devices);
+                    "pcdev-%d", minor);
   if (IS_ERR(pcdrv_data.device_pcd)) {
     dev_err(dev, "device create failed");
     ret = PTR_ERR(pcdrv_data.device_pcd);
-    cdev_del(&dev_data->cdev);
+    goto cdev_del;
   }
 
-  pcdrv_data.total_devices++;
-
   ret = pcd_sysfs_create_files(pcdrv_data.device_pcd);
   if (ret) {
     device_destroy(pcdrv_data.class_pcd, dev_data->dev_num);
-    return ret;
+    goto cdev_del;
   }
 
+  pcdrv_data.total_devices++;
+
   dev_info(dev, "The probe was successful\n");
   return 0;
+
+cdev_del:
+  cdev_del(&dev_data->cdev);
+free_minor:
+  ida_free(&pcd_minors, minor);
+free_store:
+  if (dev_data->zstore.codec) {
+    pcd_zstore_free(&dev_data->zstore);
+  }
+  pcd_storage_free(&dev_data->storage);
+  return ret;
 }
 
 /*Called when device is removed from the system*/
@@ -244,32 +468,45 @@ int pcd_platform_driver_remove(struct platform_device *pdev) {
 
   /*Remove a cdev entry from the system*/
   cdev_del(&dev_data->cdev);
+  ida_free(&pcd_minors, dev_data->dev_num - pcdrv_data.device_num_base);
+
+  if (dev_data->zstore.codec) {
+    pcd_zstore_free(&dev_data->zstore);
+  }
+  pcd_storage_free(&dev_data->storage);
 
   pcdrv_data.total_devices--;
   dev_info(dev, "A device is removed\n");
   return 0;
 }
 
-#define MAX_DEVICES 10
-
 static int __init pcd_driver_init(void) {
   int ret = 0;
-  /*Dynamically allocate a device number for MAX_DEVICE*/
-  ret = alloc_chrdev_region(&pcdrv_data.device_num_base, 0, MAX_DEVICES,
+
+  if (!max_devices || (max_devices > MINORMASK + 1)) {
+    pr_err("max_devices must be between 1 and %u\n", MINORMASK + 1);
+    return -EINVAL;
+  }
+
+  /*Dynamically allocate a device number for max_devices*/
+  ret = alloc_chrdev_region(&pcdrv_data.device_num_base, 0, max_devices,
                             "pcdevs");
   if (ret < 0) {
     pr_err("alloc chrdev failed\n");
     return ret;
   }
 
-  /*Create device class under /sys/class*/
-  /*NOTE: If kernel version < 6.4  add THIS_MODULE as the first param to the
-   * class_create*/
+  /*Create device class under /sys/class, class_create lost its owner
+   * parameter in 6.4*/
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
   pcdrv_data.class_pcd = class_create("pcd_class");
+#else
+  pcdrv_data.class_pcd = class_create(THIS_MODULE, "pcd_class");
+#endif
   if (IS_ERR(pcdrv_data.class_pcd)) {
     pr_err("class creation failed\n");
     ret = PTR_ERR(pcdrv_data.class_pcd);
-    unregister_chrdev_region(pcdrv_data.device_num_base, MAX_DEVICES);
+    unregister_chrdev_region(pcdrv_data.device_num_base, max_devices);
     return ret;
   }
 
@@ -277,7 +514,7 @@ static int __init pcd_driver_init(void) {
   ret = platform_driver_register(&pcd_platform_driver);
   if (ret < 0) {
     pr_info("pcd platform driver failed to load\n");
-    unregister_chrdev_region(pcdrv_data.device_num_base, MAX_DEVICES);
+    unregister_chrdev_region(pcdrv_data.device_num_base, max_devices);
     class_destroy(pcdrv_data.class_pcd);
   }
   pr_info("pcd platform driver loaded\n");
@@ -292,8 +529,10 @@ static void __exit pcd_driver_cleanup(void) {
   /*Class destroy*/
   class_destroy(pcdrv_data.class_pcd);
 
-  /*Unregister device numbers for MAX_DEVICES*/
-  unregister_chrdev_region(pcdrv_data.device_num_base, MAX_DEVICES);
+  ida_destroy(&pcd_minors);
+
+  /*Unregister device numbers for max_devices*/
+  unregister_chrdev_region(pcdrv_data.device_num_base, max_devices);
 
   pr_info("pcd platform driver unloaded\n");
 }
@@ -4,19 +4,24 @@
 #include <linux/cdev.h>
 #include <linux/device.h>
 #include <linux/fs.h>
+#include <linux/idr.h>
 #include <linux/kdev_t.h>
 #include <linux/mod_devicetable.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/of.h>
 #include <linux/of_device.h>
 #include <linux/platform_device.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/uaccess.h>
+#include <linux/version.h>
+
+#include "pcd_core.h"
 
 #undef pr_fmt
 #define pr_fmt(fmt) "%s :" fmt, __func__
 
-int check_permission(int dev_perm, int acc_mode);
 loff_t pcd_llseek(struct file *filep, loff_t offset, int whence);
 
 ssize_t pcd_read(struct file *filep, char __user *buff, size_t count,
@@ -29,15 +34,116 @@ int pcd_open(struct inode *inode, struct file *filep);
 
 int pcd_release(struct inode *inode, struct file *filep);
 
+/*number of uncompressed pages kept per compressed device*/
+#define PCD_HOT_PAGES 8
+
+struct pcd_zstore;
+
+/*compression algorithm of a compressed device, picked by org,compress*/
+struct pcd_codec {
+  const char *name;
+  int (*init)(struct pcd_zstore *zs);
+  size_t (*compress)(struct pcd_zstore *zs, const void *src, void *dst);
+  int (*decompress)(struct pcd_zstore *zs, const void *src, size_t len,
+                    void *dst);
+};
+
+struct pcd_hot {
+  unsigned long index;
+  void *data;
+  bool dirty;
+  u64 used;
+};
+
+/*Compressed device memory, one object per page, NULL for zero pages*/
+struct pcd_zstore {
+  const struct pcd_codec *codec;
+  void **objs;
+  /*compressed size of each object, PAGE_SIZE when stored uncompressed*/
+  u32 *lens;
+  unsigned long nr_pages;
+  void *scratch;
+  void *cwrk;
+  void *dwrk;
+  void *cctx;
+  void *dctx;
+  struct pcd_hot hot[PCD_HOT_PAGES];
+  u64 clock;
+  /*statistics, reported through sysfs*/
+  u64 stored_pages;
+  u64 stored_bytes;
+  u64 decompressions;
+  u64 decompress_ns;
+  u64 hot_hits;
+};
+
+const struct pcd_codec *pcd_codec_find(const char *name);
+int pcd_zstore_init(struct pcd_zstore *zs, const struct pcd_codec *codec,
+                    size_t size);
+void pcd_zstore_free(struct pcd_zstore *zs);
+ssize_t pcd_zstore_read(struct pcd_zstore *zs, char __user *buff,
+                        size_t count, loff_t pos);
+ssize_t pcd_zstore_write(struct pcd_zstore *zs, const char __user *buff,
+                         size_t count, loff_t pos);
+
+/*burst tolerance of a new device, in ms of its rate*/
+#define PCD_QOS_BURST_MS 100
+/*wait histogram, bucket i counts waits below 2^(i+1) us*/
+#define PCD_QOS_HIST_BUCKETS 16
+
+/*GCRA token bucket, the theoretical arrival time of the next request*/
+struct pcd_bucket {
+  u64 tat;
+};
+
+/*Rate limits of a device, 0 means unlimited. The file limits apply to each
+ * open file on its own*/
+struct pcd_qos {
+  spinlock_t lock;
+  bool limited;
+  u64 bytes_rate;
+  u64 ops_rate;
+  u64 file_bytes_rate;
+  u64 file_ops_rate;
+  u32 burst_ms;
+  struct pcd_bucket bytes;
+  struct pcd_bucket ops;
+  /*bumped by every limit change, open files reset their buckets on it*/
+  u64 gen;
+  /*statistics, reported through sysfs*/
+  u64 throttled;
+  u64 wait_ns;
+  u64 wait_hist[PCD_QOS_HIST_BUCKETS];
+};
 
 /*Device private data structure*/
 struct pcdev_private_data {
   struct pcdev_platform_data pdata;
-  char *buffer;
+  /*memory of a plain device, zstore.codec is set for a compressed one*/
+  struct pcd_storage storage;
+  /*bytes allocated for storage, the limit of max_size*/
+  int capacity;
+  struct pcd_zstore zstore;
   dev_t dev_num;
   struct cdev cdev;
+  /*serializes accesses to the device memory*/
+  struct mutex lock;
+  struct pcd_qos qos;
+};
+
+/*Per open file data*/
+struct pcd_file {
+  struct pcdev_private_data *dev_data;
+  struct pcd_bucket bytes;
+  struct pcd_bucket ops;
+  /*qos.gen the buckets were last charged under*/
+  u64 gen;
 };
 
+void pcd_qos_init(struct pcd_qos *qos);
+int pcd_qos_throttle(struct pcd_file *pfile, size_t count);
+void pcd_qos_set(struct pcd_qos *qos, u64 *limit, u64 value);
+
 /*Driver private data structure*/
 struct pcdrv_private_data {
   int total_devices;
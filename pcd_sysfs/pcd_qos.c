@@ -0,0 +1,129 @@
+#include <linux/hrtimer.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/sched/signal.h>
+
+#include "pcd_platform_driver_device_tree_sysfs.h"
+
+/*
+ * Rate limits of a device, as GCRA token buckets: each bucket keeps the
+ * theoretical arrival time (tat) of the next request. A request of n units
+ * pushes tat by n / rate seconds and may start once it is no more than the
+ * burst tolerance ahead of now, otherwise the caller sleeps until then.
+ * Reserving the slot before sleeping serves throttled callers in the order
+ * they arrived, a sleep cut short by a signal gives the slot back.
+ */
+
+void pcd_qos_init(struct pcd_qos *qos) {
+  memset(qos, 0, sizeof(*qos));
+  spin_lock_init(&qos->lock);
+  qos->burst_ms = PCD_QOS_BURST_MS;
+}
+
+/*charge units to b, returns how long the caller has to wait in ns*/
+static u64 pcd_bucket_charge(struct pcd_bucket *b, u64 rate, u64 tau, u64 now,
+                             u64 units) {
+  u64 tat, wait;
+
+  if (!rate) {
+    return 0;
+  }
+
+  tat = max(b->tat, now);
+  wait = (tat > now + tau) ? tat - now - tau : 0;
+  b->tat = tat + div64_u64(units * NSEC_PER_SEC, rate);
+
+  return wait;
+}
+
+/*undo a charge of units to b, for a caller that never got to run*/
+static void pcd_bucket_refund(struct pcd_bucket *b, u64 rate, u64 units) {
+  u64 cost;
+
+  if (!rate) {
+    return;
+  }
+
+  cost = div64_u64(units * NSEC_PER_SEC, rate);
+  b->tat = (b->tat > cost) ? b->tat - cost : 0;
+}
+
+static void pcd_qos_account(struct pcd_qos *qos, u64 wait) {
+  int bucket;
+
+  qos->throttled++;
+  qos->wait_ns += wait;
+  bucket = ilog2(max_t(u64, wait / NSEC_PER_USEC, 1));
+  qos->wait_hist[min(bucket, PCD_QOS_HIST_BUCKETS - 1)]++;
+}
+
+/*sleep until the device's and the file's buckets admit count bytes*/
+int pcd_qos_throttle(struct pcd_file *pfile, size_t count) {
+  struct pcd_qos *qos = &pfile->dev_data->qos;
+  u64 now, tau, wait, gen;
+  ktime_t timeout;
+
+  /*no limits set, don't touch the lock*/
+  if (!READ_ONCE(qos->limited)) {
+    return 0;
+  }
+
+  spin_lock(&qos->lock);
+  /*limits changed since the file was last charged, start it full as well*/
+  if (pfile->gen != qos->gen) {
+    pfile->bytes.tat = 0;
+    pfile->ops.tat = 0;
+    pfile->gen = qos->gen;
+  }
+  gen = qos->gen;
+  now = ktime_get_ns();
+  tau = (u64)qos->burst_ms * NSEC_PER_MSEC;
+  wait = pcd_bucket_charge(&qos->bytes, qos->bytes_rate, tau, now, count);
+  wait = max(wait, pcd_bucket_charge(&qos->ops, qos->ops_rate, tau, now, 1));
+  wait = max(wait, pcd_bucket_charge(&pfile->bytes, qos->file_bytes_rate, tau,
+                                     now, count));
+  wait = max(wait,
+             pcd_bucket_charge(&pfile->ops, qos->file_ops_rate, tau, now, 1));
+  if (wait) {
+    pcd_qos_account(qos, wait);
+  }
+  spin_unlock(&qos->lock);
+
+  if (!wait) {
+    return 0;
+  }
+
+  timeout = ns_to_ktime(wait);
+  set_current_state(TASK_INTERRUPTIBLE);
+  schedule_hrtimeout(&timeout, HRTIMER_MODE_REL);
+
+  if (!signal_pending(current)) {
+    return 0;
+  }
+
+  /*interrupted, the request won't run. A limit change meanwhile already
+   * reset the buckets, nothing left to give back then*/
+  spin_lock(&qos->lock);
+  if (qos->gen == gen) {
+    pcd_bucket_refund(&qos->bytes, qos->bytes_rate, count);
+    pcd_bucket_refund(&qos->ops, qos->ops_rate, 1);
+    pcd_bucket_refund(&pfile->bytes, qos->file_bytes_rate, count);
+    pcd_bucket_refund(&pfile->ops, qos->file_ops_rate, 1);
+  }
+  spin_unlock(&qos->lock);
+
+  return -ERESTARTSYS;
+}
+
+/*a new limit starts with full buckets, the device's now and each open
+ * file's on its next request*/
+void pcd_qos_set(struct pcd_qos *qos, u64 *limit, u64 value) {
+  spin_lock(&qos->lock);
+  *limit = value;
+  qos->bytes.tat = 0;
+  qos->ops.tat = 0;
+  qos->gen++;
+  WRITE_ONCE(qos->limited, qos->bytes_rate || qos->ops_rate ||
+                               qos->file_bytes_rate || qos->file_ops_rate);
+  spin_unlock(&qos->lock);
+}
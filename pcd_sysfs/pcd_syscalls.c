@@ -1,40 +1,122 @@
 #include "pcd_platform_driver_device_tree_sysfs.h"
 
-int check_permission(int dev_perm, int acc_mode) {
-  if (dev_perm == RDWR) {
-    return 0;
-  }
+loff_t pcd_llseek(struct file *filep, loff_t offset, int whence) {
+  struct pcd_file *pfile = filep->private_data;
 
-  // Ensure read only actions
-  if ((dev_perm == RDONLY) &&
-      ((acc_mode & FMODE_READ) && !(acc_mode & FMODE_WRITE))) {
-    return 0;
-  }
+  return pcd_core_llseek(filep, offset, whence, pfile->dev_data->pdata.size);
+}
 
-  // Ensure write only actions
-  if ((dev_perm == WRONLY) &&
-      ((acc_mode & FMODE_WRITE) && !(acc_mode & FMODE_READ))) {
-    return 0;
+ssize_t pcd_read(struct file *filep, char __user *buff, size_t count,
+                 loff_t *f_pos) {
+  struct pcd_file *pfile = filep->private_data;
+  struct pcdev_private_data *dev_data = pfile->dev_data;
+  loff_t max_size;
+  ssize_t ret;
+
+  /*charged up front, for at most the device size*/
+  ret = pcd_qos_throttle(
+      pfile, min_t(size_t, count, READ_ONCE(dev_data->pdata.size)));
+  if (ret) {
+    return ret;
   }
 
-  return -EPERM;
-}
+  mutex_lock(&dev_data->lock);
+  max_size = dev_data->pdata.size;
 
-loff_t pcd_llseek(struct file *filep, loff_t offset, int whence) { return 0; }
+  /* Adjust the count */
+  count = pcd_core_clamp(*f_pos, count, max_size);
 
-ssize_t pcd_read(struct file *filep, char __user *buff, size_t count,
-                 loff_t *f_pos) {
-  return 0;
+  if (dev_data->zstore.codec) {
+    ret = pcd_zstore_read(&dev_data->zstore, buff, count, *f_pos);
+  } else {
+    ret = pcd_storage_read(&dev_data->storage, buff, count, *f_pos);
+  }
+  mutex_unlock(&dev_data->lock);
+  if (ret < 0) {
+    return ret;
+  }
+
+  /*update the current file position*/
+  *f_pos += ret;
+
+  return ret;
 }
 
 ssize_t pcd_write(struct file *filep, const char __user *buff, size_t count,
                   loff_t *f_pos) {
-  return -ENOMEM;
+  struct pcd_file *pfile = filep->private_data;
+  struct pcdev_private_data *dev_data = pfile->dev_data;
+  loff_t max_size;
+  ssize_t ret;
+
+  /*nothing to write, nothing to charge*/
+  if (!count) {
+    return 0;
+  }
+
+  /*charged up front, for at most the device size*/
+  ret = pcd_qos_throttle(
+      pfile, min_t(size_t, count, READ_ONCE(dev_data->pdata.size)));
+  if (ret) {
+    return ret;
+  }
+
+  mutex_lock(&dev_data->lock);
+  max_size = dev_data->pdata.size;
+
+  /* Adjust the count */
+  ret = pcd_core_write_count(*f_pos, count, max_size);
+  if (ret <= 0) {
+    mutex_unlock(&dev_data->lock);
+    return ret;
+  }
+  count = ret;
+
+  if (dev_data->zstore.codec) {
+    ret = pcd_zstore_write(&dev_data->zstore, buff, count, *f_pos);
+  } else {
+    ret = pcd_storage_write(&dev_data->storage, buff, count, *f_pos);
+  }
+  mutex_unlock(&dev_data->lock);
+  if (ret < 0) {
+    return ret;
+  }
+
+  /*update the current file position*/
+  *f_pos += ret;
+
+  return ret;
 }
 
-int pcd_open(struct inode *inode, struct file *filep) { return 0; }
+int pcd_open(struct inode *inode, struct file *filep) {
+  struct pcdev_private_data *dev_data;
+  struct pcd_file *pfile;
+  int ret;
+
+  /*get device's private data structure*/
+  dev_data = container_of(inode->i_cdev, struct pcdev_private_data, cdev);
+
+  /*check permission*/
+  ret = pcd_core_check_permission(dev_data->pdata.perm, filep->f_mode);
+  if (ret) {
+    return ret;
+  }
+
+  /*the file carries its own rate limit buckets*/
+  pfile = kzalloc(sizeof(*pfile), GFP_KERNEL);
+  if (!pfile) {
+    return -ENOMEM;
+  }
+  pfile->dev_data = dev_data;
+
+  /*to supply device private data to other methods of the driver*/
+  filep->private_data = pfile;
+
+  return 0;
+}
 
 int pcd_release(struct inode *inode, struct file *filep) {
+  kfree(filep->private_data);
   pr_info("release was successful\n");
   return 0;
 }
@@ -4,109 +4,75 @@
 #include <linux/kdev_t.h>
 #include <linux/module.h>
 #include <linux/uaccess.h>
+#include <linux/version.h>
+
+#include "pcd_core.h"
 
 #undef pr_fmt
 #define pr_fmt(fmt) "%s :" fmt, __func__
 
 #define DEV_MEM_SIZE 512
 
+static char *backend = PCD_DEFAULT_BACKEND;
+module_param(backend, charp, 0444);
+MODULE_PARM_DESC(backend, "storage backend of the device, contig, vmalloc or "
+                          "pages");
+
 /*pseudo device's memory*/
-char device_buffer[DEV_MEM_SIZE];
+struct pcd_storage pcd_storage;
 
 dev_t device_number;
 
 /*Cdev variable*/
 struct cdev pcd_cdev;
 
+/*no printk on the data path, it is unbounded on PREEMPT_RT*/
 loff_t pcd_llseek(struct file *filep, loff_t offset, int whence) {
-  pr_info("lseek requested\n");
-
-  loff_t temp = 0;
-  pr_info("current file position %lld\n", filep->f_pos);
-
-  switch (whence) {
-  case SEEK_SET:
-    if ((offset > DEV_MEM_SIZE) || (offset < 0)) {
-      return -EINVAL;
-    }
-    filep->f_pos = offset;
-    break;
-  case SEEK_CUR:
-    temp = filep->f_pos + offset;
-    if ((temp > DEV_MEM_SIZE) || (temp < 0)) {
-      return -EINVAL;
-    }
-
-    filep->f_pos = temp;
-    break;
-  case SEEK_END:
-    temp = DEV_MEM_SIZE + offset;
-    if ((temp > DEV_MEM_SIZE) || (temp < 0)) {
-      return -EINVAL;
-    }
-    filep->f_pos = temp;
-
-    break;
-  default:
-    return -EINVAL;
-  }
-
-  pr_info("updated file position %lld\n", filep->f_pos);
-  return filep->f_pos;
+  return pcd_core_llseek(filep, offset, whence, DEV_MEM_SIZE);
 }
 
 ssize_t pcd_read(struct file *filep, char __user *buff, size_t count,
                  loff_t *f_pos) {
-  pr_info("%zu byte(s) read requested\n", count);
-  pr_info("current file position = %lld \n", *f_pos);
-  /* Adjust the count */
-  if ((*f_pos + count) > DEV_MEM_SIZE) {
-    count = DEV_MEM_SIZE - *f_pos;
-  }
+  ssize_t ret;
+
+  /* Adjust the count, pread can start past the end*/
+  count = pcd_core_clamp(*f_pos, count, DEV_MEM_SIZE);
 
   /*copy to user */
-  if (copy_to_user(buff, &device_buffer[*f_pos], count)) {
-    return -EFAULT;
+  ret = pcd_storage_read(&pcd_storage, buff, count, *f_pos);
+  if (ret < 0) {
+    return ret;
   }
 
   /*update the current file position*/
-  *f_pos += count;
-
-  pr_info("number of bytes successfully read = %zu\n", count);
-  pr_info("current file position = %lld \n", *f_pos);
+  *f_pos += ret;
 
   /*Return the number of bytes which have been successfully read*/
-  return count;
+  return ret;
 }
 
 ssize_t pcd_write(struct file *filep, const char __user *buff, size_t count,
                   loff_t *f_pos) {
-  pr_info("%zu byte(s) write requested\n", count);
+  ssize_t ret;
 
-  pr_info("current file position = %lld \n", *f_pos);
-  /* Adjust the count */
-  if ((*f_pos + count) > DEV_MEM_SIZE) {
-    count = DEV_MEM_SIZE - *f_pos;
-  }
-
-  if (!count) {
-    pr_err("no space left on the device\n");
-    return -ENOMEM;
+  /* Adjust the count, pwrite can start past the end*/
+  ret = pcd_core_write_count(*f_pos, count, DEV_MEM_SIZE);
+  if (ret <= 0) {
+    return ret;
   }
+  count = ret;
 
   /*copy from user */
-  if (copy_from_user(&device_buffer[*f_pos], buff, count)) {
-    return -EFAULT;
+  ret = pcd_storage_write(&pcd_storage, buff, count, *f_pos);
+  if (ret < 0) {
+    return ret;
   }
 
   /*update the current file position*/
-  *f_pos += count;
-
-  pr_info("number of bytes successfully written = %zu\n", count);
-  pr_info("current file position = %lld \n", *f_pos);
+  *f_pos += ret;
 
   /*Return the number of bytes which have been successfully written*/
-  return count;
+  return ret;
 }
 
 int pcd_open(struct inode *inode, struct file *filep) {
@@ -133,11 +99,18 @@ struct device *device_pcd;
 static int __init pcd_driver_init(void) {
 
   int ret;
+
+  ret = pcd_storage_init(&pcd_storage, backend, DEV_MEM_SIZE);
+  if (ret) {
+    pr_err("cannot set up %s storage\n", backend);
+    goto out;
+  }
+
   /*Dynamically allocate a device number*/
   ret = alloc_chrdev_region(&device_number, 0, 1, "pcd_devices");
   if (ret < 0) {
     pr_err("could not allocate device number\n");
-    goto out;
+    goto free_storage;
   }
 
   pr_info("Device number <major>:<minor> = %d:%d\n", MAJOR(device_number),
@@ -154,11 +127,13 @@ static int __init pcd_driver_init(void) {
     goto unreg_chrdev;
   }
 
-  /*create device class under /sys/calss
-  side-note: after kernel version 6.3, class_create only takes single
-  parameter, the name.*/
-  /*class_pcd = class_create(THIS_MODULE, "pcd_class");*/
+  /*Create device class under /sys/class, class_create lost its owner
+   * parameter in 6.4*/
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
   class_pcd = class_create("pcd_class");
+#else
+  class_pcd = class_create(THIS_MODULE, "pcd_class");
+#endif
   if (IS_ERR(class_pcd)) {
     pr_err("Class creation failed\n");
     ret = PTR_ERR(class_pcd);
@@ -182,6 +157,8 @@ cdev_del:
   cdev_del(&pcd_cdev);
 unreg_chrdev:
   unregister_chrdev_region(device_number, 1);
+free_storage:
+  pcd_storage_free(&pcd_storage);
 out:
   pr_err("module insertion failed\n");
   return ret;
@@ -192,6 +169,7 @@ static void __exit pcd_driver_cleanup(void) {
   class_destroy(class_pcd);
   cdev_del(&pcd_cdev);
   unregister_chrdev_region(device_number, 1);
+  pcd_storage_free(&pcd_storage);
 
   pr_info("module unloaded\n");
 }
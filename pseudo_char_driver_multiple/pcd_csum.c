@@ -0,0 +1,117 @@
+#include <crypto/hash.h>
+#include <linux/xxhash.h>
+
+#include "pcd_m.h"
+
+/*crc32c goes through the crypto API so the accelerated driver gets used*/
+static struct crypto_shash *pcd_crc32c_tfm;
+
+int pcd_csum_init(void) {
+  pcd_crc32c_tfm = crypto_alloc_shash("crc32c", 0, 0);
+  if (IS_ERR(pcd_crc32c_tfm)) {
+    pr_err("crc32c is not available\n");
+    return PTR_ERR(pcd_crc32c_tfm);
+  }
+
+  pr_info("crc32c provided by %s\n",
+          crypto_shash_driver_name(pcd_crc32c_tfm));
+  return 0;
+}
+
+void pcd_csum_exit(void) { crypto_free_shash(pcd_crc32c_tfm); }
+
+static int pcd_crc32c_update(void *ctx, const void *data, size_t len) {
+  return crypto_shash_update(ctx, data, len);
+}
+
+static int pcd_xxh64_update(void *ctx, const void *data, size_t len) {
+  return xxh64_update(ctx, data, len);
+}
+
+static int pcd_crc32c_range(struct pcd_store *store, loff_t pos, size_t len,
+                            u32 *crc) {
+  SHASH_DESC_ON_STACK(desc, pcd_crc32c_tfm);
+  __le32 out = 0;
+  int ret;
+
+  desc->tfm = pcd_crc32c_tfm;
+  ret = crypto_shash_init(desc);
+  if (ret) {
+    return ret;
+  }
+
+  ret = pcd_store_walk(store, pos, len, pcd_crc32c_update, desc);
+  if (!ret) {
+    ret = crypto_shash_final(desc, (u8 *)&out);
+  }
+  shash_desc_zero(desc);
+
+  *crc = le32_to_cpu(out);
+  return ret;
+}
+
+/*crc32c of every page in the range, reusing the cached ones*/
+static int pcd_crc32c_pages(struct pcd_store *store, loff_t pos, size_t len,
+                            u32 *crc) {
+  SHASH_DESC_ON_STACK(desc, pcd_crc32c_tfm);
+  pgoff_t index, last = (pos + len - 1) >> PAGE_SHIFT;
+  __le32 page_crc, out = 0;
+  loff_t start;
+  int ret;
+
+  desc->tfm = pcd_crc32c_tfm;
+  ret = crypto_shash_init(desc);
+  if (ret) {
+    return ret;
+  }
+
+  for (index = pos >> PAGE_SHIFT; index <= last; index++) {
+    /*validate before computing, a write meanwhile clears the bit again*/
+    if (!test_and_set_bit(index, store->csum_valid)) {
+      start = (loff_t)index << PAGE_SHIFT;
+      ret = pcd_crc32c_range(store, start,
+                             min_t(size_t, PAGE_SIZE, store->size - start),
+                             &store->csums[index]);
+      if (ret) {
+        clear_bit(index, store->csum_valid);
+        goto out;
+      }
+    }
+
+    page_crc = cpu_to_le32(store->csums[index]);
+    ret = crypto_shash_update(desc, (u8 *)&page_crc, sizeof(page_crc));
+    if (ret) {
+      goto out;
+    }
+  }
+
+  ret = crypto_shash_final(desc, (u8 *)&out);
+  *crc = le32_to_cpu(out);
+out:
+  shash_desc_zero(desc);
+  return ret;
+}
+
+/*caller holds the range lock, exclusive with PCD_CSUM_PAGES*/
+int pcd_store_checksum(struct pcd_store *store, struct pcd_checksum *args) {
+  struct xxh64_state state;
+  u32 crc;
+  int ret;
+
+  if (args->algo == PCD_CSUM_XXH64) {
+    xxh64_reset(&state, 0);
+    ret = pcd_store_walk(store, args->offset, args->len, pcd_xxh64_update,
+                         &state);
+    args->csum = xxh64_digest(&state);
+    return ret;
+  }
+
+  if ((args->flags & PCD_CSUM_PAGES) && args->len) {
+    ret = pcd_crc32c_pages(store, args->offset, args->len, &crc);
+  } else {
+    ret = pcd_crc32c_range(store, args->offset, args->len, &crc);
+  }
+  args->csum = crc;
+
+  return ret;
+}
@@ -0,0 +1,285 @@
+#include <linux/dma-buf.h>
+#include <linux/dma-mapping.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/version.h>
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+#include <linux/iosys-map.h>
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0)
+#include <linux/dma-buf-map.h>
+#endif
+
+#include "pcd_m.h"
+
+/*
+ * dma-buf exporter. An export pins every page of the device, importers map
+ * the pages the char and block interfaces read and write, nothing is
+ * copied. The dma-buf holds a module reference and its own page references,
+ * so it outlives the file it was exported from.
+ */
+
+struct pcd_dmabuf_priv {
+  struct pcdev_private_data *pcdev_data;
+  struct page **pages;
+  unsigned long nr_pages;
+  /*attachments, walked by the cpu access hooks*/
+  struct mutex lock;
+  struct list_head attachments;
+};
+
+struct pcd_dmabuf_attachment {
+  struct device *dev;
+  struct sg_table sgt;
+  /*direction of the current mapping, DMA_NONE while unmapped*/
+  enum dma_data_direction dir;
+  struct list_head node;
+};
+
+static int pcd_dmabuf_attach(struct dma_buf *dmabuf,
+                             struct dma_buf_attachment *attach) {
+  struct pcd_dmabuf_priv *priv = dmabuf->priv;
+  struct pcd_dmabuf_attachment *a;
+  int ret;
+
+  a = kzalloc(sizeof(*a), GFP_KERNEL);
+  if (!a) {
+    return -ENOMEM;
+  }
+
+  ret = sg_alloc_table_from_pages(&a->sgt, priv->pages, priv->nr_pages, 0,
+                                  priv->nr_pages << PAGE_SHIFT, GFP_KERNEL);
+  if (ret) {
+    kfree(a);
+    return ret;
+  }
+  a->dev = attach->dev;
+  a->dir = DMA_NONE;
+  attach->priv = a;
+
+  mutex_lock(&priv->lock);
+  list_add(&a->node, &priv->attachments);
+  mutex_unlock(&priv->lock);
+
+  return 0;
+}
+
+static void pcd_dmabuf_detach(struct dma_buf *dmabuf,
+                              struct dma_buf_attachment *attach) {
+  struct pcd_dmabuf_priv *priv = dmabuf->priv;
+  struct pcd_dmabuf_attachment *a = attach->priv;
+
+  mutex_lock(&priv->lock);
+  list_del(&a->node);
+  mutex_unlock(&priv->lock);
+
+  sg_free_table(&a->sgt);
+  kfree(a);
+}
+
+static struct sg_table *pcd_dmabuf_map(struct dma_buf_attachment *attach,
+                                       enum dma_data_direction dir) {
+  struct pcd_dmabuf_priv *priv = attach->dmabuf->priv;
+  struct pcd_dmabuf_attachment *a = attach->priv;
+  int ret;
+
+  ret = dma_map_sgtable(attach->dev, &a->sgt, dir, 0);
+  if (ret) {
+    return ERR_PTR(ret);
+  }
+
+  mutex_lock(&priv->lock);
+  a->dir = dir;
+  mutex_unlock(&priv->lock);
+
+  return &a->sgt;
+}
+
+static void pcd_dmabuf_unmap(struct dma_buf_attachment *attach,
+                             struct sg_table *sgt,
+                             enum dma_data_direction dir) {
+  struct pcd_dmabuf_priv *priv = attach->dmabuf->priv;
+  struct pcd_dmabuf_attachment *a = attach->priv;
+
+  mutex_lock(&priv->lock);
+  a->dir = DMA_NONE;
+  mutex_unlock(&priv->lock);
+
+  dma_unmap_sgtable(attach->dev, sgt, dir, 0);
+}
+
+static int pcd_dmabuf_begin_cpu_access(struct dma_buf *dmabuf,
+                                       enum dma_data_direction dir) {
+  struct pcd_dmabuf_priv *priv = dmabuf->priv;
+  struct pcd_dmabuf_attachment *a;
+
+  mutex_lock(&priv->lock);
+  list_for_each_entry(a, &priv->attachments, node) {
+    if (a->dir != DMA_NONE) {
+      dma_sync_sgtable_for_cpu(a->dev, &a->sgt, a->dir);
+    }
+  }
+  mutex_unlock(&priv->lock);
+
+  return 0;
+}
+
+static int pcd_dmabuf_end_cpu_access(struct dma_buf *dmabuf,
+                                     enum dma_data_direction dir) {
+  struct pcd_dmabuf_priv *priv = dmabuf->priv;
+  struct pcd_dmabuf_attachment *a;
+  unsigned long i;
+
+  mutex_lock(&priv->lock);
+  list_for_each_entry(a, &priv->attachments, node) {
+    if (a->dir != DMA_NONE) {
+      dma_sync_sgtable_for_device(a->dev, &a->sgt, a->dir);
+    }
+  }
+  mutex_unlock(&priv->lock);
+
+  /*the CPU may have written, make it visible like a write() would*/
+  if (dir != DMA_FROM_DEVICE) {
+    for (i = 0; i < priv->nr_pages; i++) {
+      pcd_store_mark_dirty(&priv->pcdev_data->store, i);
+    }
+    pcd_notify(priv->pcdev_data);
+  }
+
+  return 0;
+}
+
+static int pcd_dmabuf_mmap(struct dma_buf *dmabuf, struct vm_area_struct *vma) {
+  struct pcd_dmabuf_priv *priv = dmabuf->priv;
+
+  return vm_map_pages(vma, priv->pages, priv->nr_pages);
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+static int pcd_dmabuf_vmap(struct dma_buf *dmabuf, struct iosys_map *map) {
+  struct pcd_dmabuf_priv *priv = dmabuf->priv;
+  void *vaddr;
+
+  vaddr = vmap(priv->pages, priv->nr_pages, VM_MAP, PAGE_KERNEL);
+  if (!vaddr) {
+    return -ENOMEM;
+  }
+  iosys_map_set_vaddr(map, vaddr);
+
+  return 0;
+}
+
+static void pcd_dmabuf_vunmap(struct dma_buf *dmabuf, struct iosys_map *map) {
+  vunmap(map->vaddr);
+}
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0)
+/*same mapping, the map type was still called dma_buf_map*/
+static int pcd_dmabuf_vmap(struct dma_buf *dmabuf, struct dma_buf_map *map) {
+  struct pcd_dmabuf_priv *priv = dmabuf->priv;
+  void *vaddr;
+
+  vaddr = vmap(priv->pages, priv->nr_pages, VM_MAP, PAGE_KERNEL);
+  if (!vaddr) {
+    return -ENOMEM;
+  }
+  dma_buf_map_set_vaddr(map, vaddr);
+
+  return 0;
+}
+
+static void pcd_dmabuf_vunmap(struct dma_buf *dmabuf,
+                              struct dma_buf_map *map) {
+  vunmap(map->vaddr);
+}
+#else
+/*the board kernel hands the address back directly, NULL on failure*/
+static void *pcd_dmabuf_vmap(struct dma_buf *dmabuf) {
+  struct pcd_dmabuf_priv *priv = dmabuf->priv;
+
+  return vmap(priv->pages, priv->nr_pages, VM_MAP, PAGE_KERNEL);
+}
+
+static void pcd_dmabuf_vunmap(struct dma_buf *dmabuf, void *vaddr) {
+  vunmap(vaddr);
+}
+#endif
+
+static void pcd_dmabuf_release(struct dma_buf *dmabuf) {
+  struct pcd_dmabuf_priv *priv = dmabuf->priv;
+
+  pcd_store_unpin_pages(&priv->pcdev_data->store, priv->pages);
+  kvfree(priv->pages);
+  kfree(priv);
+}
+
+static const struct dma_buf_ops pcd_dmabuf_ops = {
+    .attach = pcd_dmabuf_attach,
+    .detach = pcd_dmabuf_detach,
+    .map_dma_buf = pcd_dmabuf_map,
+    .unmap_dma_buf = pcd_dmabuf_unmap,
+    .begin_cpu_access = pcd_dmabuf_begin_cpu_access,
+    .end_cpu_access = pcd_dmabuf_end_cpu_access,
+    .mmap = pcd_dmabuf_mmap,
+    .vmap = pcd_dmabuf_vmap,
+    .vunmap = pcd_dmabuf_vunmap,
+    .release = pcd_dmabuf_release,
+};
+
+struct dma_buf *pcd_dmabuf_export(struct pcdev_private_data *pcdev_data) {
+  DEFINE_DMA_BUF_EXPORT_INFO(exp_info);
+  struct pcd_dmabuf_priv *priv;
+  struct dma_buf *dmabuf;
+  int ret;
+
+  priv = kzalloc(sizeof(*priv), GFP_KERNEL);
+  if (!priv) {
+    return ERR_PTR(-ENOMEM);
+  }
+
+  priv->pcdev_data = pcdev_data;
+  priv->nr_pages = pcdev_data->store.nr_pages;
+  mutex_init(&priv->lock);
+  INIT_LIST_HEAD(&priv->attachments);
+
+  priv->pages = kvcalloc(priv->nr_pages, sizeof(*priv->pages), GFP_KERNEL);
+  if (!priv->pages) {
+    ret = -ENOMEM;
+    goto free_priv;
+  }
+
+  /*holes get their page now, under the lock so no punch slips in between*/
+  pcd_lock_all(&pcdev_data->rlock);
+  ret = pcd_store_pin_pages(&pcdev_data->store, priv->pages);
+  pcd_unlock_all(&pcdev_data->rlock);
+  if (ret) {
+    goto free_pages;
+  }
+
+  exp_info.owner = THIS_MODULE;
+  exp_info.ops = &pcd_dmabuf_ops;
+  exp_info.size = priv->nr_pages << PAGE_SHIFT;
+  exp_info.flags = O_RDWR;
+  exp_info.priv = priv;
+
+  dmabuf = dma_buf_export(&exp_info);
+  if (IS_ERR(dmabuf)) {
+    ret = PTR_ERR(dmabuf);
+    goto unpin;
+  }
+
+  return dmabuf;
+
+unpin:
+  pcd_store_unpin_pages(&pcdev_data->store, priv->pages);
+free_pages:
+  kvfree(priv->pages);
+free_priv:
+  kfree(priv);
+  return ERR_PTR(ret);
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+MODULE_IMPORT_NS("DMA_BUF");
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5, 16, 0)
+MODULE_IMPORT_NS(DMA_BUF);
+#endif
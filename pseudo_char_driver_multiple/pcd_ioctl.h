@@ -0,0 +1,192 @@
+#ifndef PCD_IOCTL_H
+#define PCD_IOCTL_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/*ioctl interface of the pcd_m devices, shared with user space*/
+
+#define PCD_IOC_MAGIC 'p'
+
+/*
+ * Copy len bytes from src_offset of the pcd device open on src_fd to
+ * dst_offset of the device the ioctl is issued on, without going through a
+ * user buffer. The copy is clamped to the size of both devices, the number
+ * of bytes copied is returned. File positions are not changed.
+ */
+struct pcd_copy_range {
+  __s32 src_fd;
+  __u32 reserved;
+  __u64 src_offset;
+  __u64 dst_offset;
+  __u64 len;
+};
+
+#define PCD_IOC_COPY_RANGE _IOW(PCD_IOC_MAGIC, 1, struct pcd_copy_range)
+
+/*
+ * Clear len bytes at offset, mode takes the fallocate(2) flags
+ * FALLOC_FL_PUNCH_HOLE or FALLOC_FL_ZERO_RANGE, FALLOC_FL_KEEP_SIZE is
+ * accepted and implied since the device size never changes. Punching gives
+ * the pages fully inside the range back to the kernel, both modes read back
+ * as zeros afterwards.
+ */
+struct pcd_fallocate {
+  __u32 mode;
+  __u32 reserved;
+  __u64 offset;
+  __u64 len;
+};
+
+#define PCD_IOC_FALLOCATE _IOW(PCD_IOC_MAGIC, 2, struct pcd_fallocate)
+
+/*
+ * Atomic read-modify-write of a native endian 32 or 64 bit word at offset,
+ * which must be aligned to width. The value the word held before the
+ * operation is returned in old, a compare-and-swap succeeded when old equals
+ * expected. Atomic ops never take the device lock, they are atomic against
+ * each other but not against concurrent read()/write() of the same bytes.
+ */
+#define PCD_ATOMIC_CAS 0
+#define PCD_ATOMIC_FETCH_ADD 1
+#define PCD_ATOMIC_XCHG 2
+
+struct pcd_atomic {
+  __u64 offset;
+  __u64 value;
+  __u64 expected;
+  __u64 old;
+  __u32 op;
+  __u32 width;
+};
+
+#define PCD_IOC_ATOMIC _IOWR(PCD_IOC_MAGIC, 3, struct pcd_atomic)
+
+/*
+ * Fetch and clear the pages changed since the previous call. bitmap points
+ * to an array of __u64 words, bit N of word N / 64 set means page N of the
+ * device changed, size is the array size in bytes. nr_pages is always set,
+ * -ENOSPC means the array was too small for it. epoch counts the fetches
+ * done on the device, including this one.
+ */
+struct pcd_dirty {
+  __u64 bitmap;
+  __u64 size;
+  __u64 nr_pages;
+  __u64 epoch;
+};
+
+#define PCD_IOC_DIRTY _IOWR(PCD_IOC_MAGIC, 4, struct pcd_dirty)
+
+/*
+ * Export the whole device as a dma-buf, the new file descriptor is returned
+ * in fd. flags may hold O_CLOEXEC. The dma-buf maps the device pages
+ * themselves, holes are filled on export and no hole can be punched while an
+ * export is alive, FALLOC_FL_PUNCH_HOLE and discard zero the range instead.
+ */
+struct pcd_dmabuf {
+  __u32 flags;
+  __s32 fd;
+};
+
+#define PCD_IOC_EXPORT_DMABUF _IOWR(PCD_IOC_MAGIC, 5, struct pcd_dmabuf)
+
+/*
+ * Checksum len bytes at offset inside the kernel, the result is returned in
+ * csum. PCD_CSUM_CRC32C gives the standard crc32c of the range, computed
+ * through the crypto API, PCD_CSUM_XXH64 the 64 bit xxhash with seed 0.
+ *
+ * With PCD_CSUM_PAGES the range must start on a page boundary and the
+ * result is the crc32c over the little endian crc32c of each page in the
+ * range, the last page counted up to the end of the device. Page checksums
+ * are cached and only recomputed for pages changed since, so verifying a
+ * mostly unchanged device costs next to nothing.
+ */
+#define PCD_CSUM_CRC32C 0
+#define PCD_CSUM_XXH64 1
+
+#define PCD_CSUM_PAGES (1U << 0)
+
+struct pcd_checksum {
+  __u64 offset;
+  __u64 len;
+  __u32 algo;
+  __u32 flags;
+  __u64 csum;
+};
+
+#define PCD_IOC_CHECKSUM _IOWR(PCD_IOC_MAGIC, 6, struct pcd_checksum)
+
+/*
+ * Find the pattern of pattern_len bytes (at most PCD_SEARCH_MAX_PATTERN)
+ * in matches starting within [offset, offset + limit). Up to max_matches
+ * offsets are stored in the __u64 array matches points to, nr_matches says
+ * how many were found. next is where a follow-up search should start: past
+ * the last match when the array filled up, the end of the range otherwise.
+ */
+#define PCD_SEARCH_MAX_PATTERN 256
+
+struct pcd_search {
+  __u64 pattern;
+  __u64 matches;
+  __u64 offset;
+  __u64 limit;
+  __u32 pattern_len;
+  __u32 max_matches;
+  __u32 nr_matches;
+  __u32 reserved;
+  __u64 next;
+};
+
+#define PCD_IOC_SEARCH _IOWR(PCD_IOC_MAGIC, 7, struct pcd_search)
+
+/*
+ * Log mode (modes=log). Every CPU has its own ring: a control page followed
+ * by size bytes of records. mmap() at offset cpu * (PAGE_SIZE + size) with
+ * the length PAGE_SIZE + size maps the ring of that CPU. head and tail are
+ * free running byte counters, the record at tail is the oldest one.
+ *
+ * A record is a struct pcd_log_rec followed by len bytes, padded to
+ * PCD_LOG_ALIGN. It may be read once PCD_LOG_COMMIT is set in flags,
+ * PCD_LOG_DISCARD records carry nothing and are skipped, one of them fills
+ * the end of the ring when the next record does not fit there. A consumer
+ * zeroes the records it is done with before advancing tail past them.
+ *
+ * PCD_LOG_STAMPED is set while the data is still being copied in, which
+ * can take long if the writer faults or is preempted. timestamp_ns and len
+ * are valid then. A merging consumer can keep going with older records of
+ * the other rings, only newer ones have to wait for the commit.
+ */
+struct pcd_log_ctrl {
+  __u32 head;
+  __u32 tail;
+  __u32 size;
+  __u32 cpu;
+  /*records refused because the ring was full*/
+  __u32 dropped;
+  __u32 reserved;
+};
+
+#define PCD_LOG_COMMIT (1U << 0)
+#define PCD_LOG_DISCARD (1U << 1)
+#define PCD_LOG_STAMPED (1U << 2)
+#define PCD_LOG_ALIGN 16
+
+struct pcd_log_rec {
+  __u64 timestamp_ns;
+  __u32 len;
+  __u32 flags;
+};
+
+/*
+ * read() of a log device returns the records of all CPUs merged in
+ * timestamp order, each as a struct pcd_log_entry followed by len bytes of
+ * data padded to 8 bytes.
+ */
+struct pcd_log_entry {
+  __u64 timestamp_ns;
+  __u32 cpu;
+  __u32 len;
+};
+
+#endif
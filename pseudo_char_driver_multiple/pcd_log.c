@@ -0,0 +1,329 @@
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/timekeeping.h>
+#include <linux/vmalloc.h>
+
+#include "pcd_m.h"
+
+/*
+ * Log mode, every CPU appends to its own ring so writers on different CPUs
+ * share no lock and no cache line. A writer reserves space with a cmpxchg on
+ * head and stamps the record header with preemption disabled, then copies
+ * the data in and sets PCD_LOG_COMMIT last. Consumers zero the records they
+ * are done with before moving tail, so space a writer reserves always reads
+ * as zeros until the writer stamps it.
+ *
+ * A record that is stamped but not committed only holds back the records
+ * newer than it, on every ring. A writer stalled in copy_from_user therefore
+ * delays the merged stream from its timestamp on, never the older records.
+ *
+ * The rings are mapped to user space, nothing read back from them is
+ * trusted to stay in bounds.
+ */
+
+/*how long a reader waits for a reserved record to be stamped, the writer
+ * does that with preemption disabled so it is a matter of instructions*/
+#define PCD_LOG_STAMP_SPINS 1000
+
+/*records larger than this would waste most of the ring on padding*/
+#define PCD_LOG_MAX_RECORD(log) ((log)->size / 4)
+
+/*the oldest record of a ring, as read once by the consumer*/
+struct pcd_log_head {
+  struct pcd_log_rec *rec;
+  u64 timestamp_ns;
+  u32 len;
+  u32 span;
+};
+
+static inline struct pcd_log_rec *pcd_log_rec(struct pcd_log *log,
+                                              struct pcd_log_ctrl *ctrl,
+                                              u32 pos) {
+  return (void *)ctrl + PAGE_SIZE +
+         (pos & (log->size - 1) & ~(PCD_LOG_ALIGN - 1));
+}
+
+int pcd_log_init(struct pcd_log *log, size_t size) {
+  struct pcd_log_ctrl *ctrl;
+  int cpu;
+
+  log->size = roundup_pow_of_two(max_t(size_t, size, PAGE_SIZE));
+  mutex_init(&log->read_lock);
+
+  log->cpus = kcalloc(nr_cpu_ids, sizeof(*log->cpus), GFP_KERNEL);
+  if (!log->cpus) {
+    return -ENOMEM;
+  }
+
+  for_each_possible_cpu(cpu) {
+    /*zeroed, which is what an empty ring looks like*/
+    ctrl = vmalloc_user(PAGE_SIZE + log->size);
+    if (!ctrl) {
+      pcd_log_free(log);
+      return -ENOMEM;
+    }
+    ctrl->size = log->size;
+    ctrl->cpu = cpu;
+    log->cpus[cpu] = ctrl;
+  }
+
+  return 0;
+}
+
+void pcd_log_free(struct pcd_log *log) {
+  int cpu;
+
+  if (!log->cpus) {
+    return;
+  }
+
+  for_each_possible_cpu(cpu) {
+    vfree(log->cpus[cpu]);
+  }
+  kfree(log->cpus);
+  log->cpus = NULL;
+}
+
+static void pcd_log_wake(struct pcdev_private_data *pcdev_data) {
+  if (wq_has_sleeper(&pcdev_data->wq)) {
+    wake_up_interruptible_poll(&pcdev_data->wq, EPOLLIN | EPOLLRDNORM);
+  }
+  kill_fasync(&pcdev_data->fasync, SIGIO, POLL_IN);
+}
+
+/*append one record to the ring of the local CPU, a full ring drops it*/
+ssize_t pcd_log_write(struct pcdev_private_data *pcdev_data,
+                      const char __user *buff, size_t count) {
+  struct pcd_log *log = &pcdev_data->log;
+  struct pcd_log_ctrl *ctrl;
+  struct pcd_log_rec *rec;
+  u32 head, tail, off, pad, need, flags, dropped;
+  u64 ts;
+
+  if (!count) {
+    return 0;
+  }
+  if (count > PCD_LOG_MAX_RECORD(log)) {
+    return -EMSGSIZE;
+  }
+  need = ALIGN(sizeof(*rec) + count, PCD_LOG_ALIGN);
+
+  /*a reserved record stays unstamped only while preemption is off, readers
+   * cannot tell how old it is until then*/
+  preempt_disable();
+  ctrl = log->cpus[smp_processor_id()];
+
+  /*plain cmpxchg loops, 32 bit ARM on 5.10 has no try_cmpxchg*/
+  do {
+    head = READ_ONCE(ctrl->head);
+    off = head & (log->size - 1) & ~(PCD_LOG_ALIGN - 1);
+    pad = (off + need > log->size) ? log->size - off : 0;
+    /*pairs with the release in pcd_log_consume, freed space is zeroed*/
+    tail = smp_load_acquire(&ctrl->tail);
+    if (head + pad + need - tail > log->size) {
+      do {
+        dropped = READ_ONCE(ctrl->dropped);
+      } while (cmpxchg(&ctrl->dropped, dropped, dropped + 1) != dropped);
+      preempt_enable();
+      return -ENOSPC;
+    }
+    ts = ktime_get_ns();
+  } while (cmpxchg(&ctrl->head, head, head + pad + need) != head);
+
+  if (pad) {
+    rec = pcd_log_rec(log, ctrl, head);
+    rec->timestamp_ns = ts;
+    rec->len = pad - sizeof(*rec);
+    smp_store_release(&rec->flags, PCD_LOG_COMMIT | PCD_LOG_DISCARD);
+    head += pad;
+  }
+
+  rec = pcd_log_rec(log, ctrl, head);
+  rec->timestamp_ns = ts;
+  rec->len = count;
+  smp_store_release(&rec->flags, PCD_LOG_STAMPED);
+  preempt_enable();
+
+  flags = PCD_LOG_COMMIT;
+  if (copy_from_user(rec + 1, buff, count)) {
+    /*the space is taken already, commit it as a record nobody reads*/
+    flags |= PCD_LOG_DISCARD;
+  }
+  smp_store_release(&rec->flags, flags);
+
+  pcd_log_wake(pcdev_data);
+
+  return (flags & PCD_LOG_DISCARD) ? -EFAULT : count;
+}
+
+/*the oldest record of ctrl's ring, -ENODATA when there is none, -EBUSY
+ * while it is still being written and -EAGAIN when it is to be skipped. A
+ * busy record's timestamp is 0 until the writer has stamped it*/
+static int pcd_log_peek(struct pcd_log *log, struct pcd_log_ctrl *ctrl,
+                        struct pcd_log_head *h) {
+  u32 tail = READ_ONCE(ctrl->tail);
+  u32 flags, room;
+  int spins;
+
+  if (READ_ONCE(ctrl->head) == tail) {
+    return -ENODATA;
+  }
+
+  h->rec = pcd_log_rec(log, ctrl, tail);
+  flags = smp_load_acquire(&h->rec->flags);
+  /*bounded, the ring is mapped and a user may have zeroed the flags*/
+  for (spins = 0; !flags && (spins < PCD_LOG_STAMP_SPINS); spins++) {
+    cpu_relax();
+    flags = smp_load_acquire(&h->rec->flags);
+  }
+  h->timestamp_ns = 0;
+  if ((flags & PCD_LOG_STAMPED) || (flags & PCD_LOG_COMMIT)) {
+    h->timestamp_ns = READ_ONCE(h->rec->timestamp_ns);
+  }
+  if (!(flags & PCD_LOG_COMMIT)) {
+    return -EBUSY;
+  }
+
+  h->len = READ_ONCE(h->rec->len);
+  room = log->size - ((void *)h->rec - (void *)ctrl - PAGE_SIZE);
+  if (h->len > room - sizeof(*h->rec)) {
+    /*a corrupted record, throw away the rest of the ring*/
+    h->len = room - sizeof(*h->rec);
+    flags |= PCD_LOG_DISCARD;
+  }
+  h->span = ALIGN(sizeof(*h->rec) + h->len, PCD_LOG_ALIGN);
+
+  return (flags & PCD_LOG_DISCARD) ? -EAGAIN : 0;
+}
+
+static void pcd_log_consume(struct pcd_log_ctrl *ctrl,
+                            struct pcd_log_head *h) {
+  memset(h->rec, 0, h->span);
+  smp_store_release(&ctrl->tail, ctrl->tail + h->span);
+}
+
+/*the oldest record over all CPUs. Records still being written are skipped
+ * only while the oldest committed one is older than all of them, -EBUSY
+ * otherwise*/
+static int pcd_log_next(struct pcd_log *log, struct pcd_log_head *oldest,
+                        int *oldest_cpu) {
+  struct pcd_log_head h;
+  u64 busy_ns = U64_MAX;
+  int ret, cpu;
+
+  *oldest_cpu = -1;
+  for_each_possible_cpu(cpu) {
+    while ((ret = pcd_log_peek(log, log->cpus[cpu], &h)) == -EAGAIN) {
+      pcd_log_consume(log->cpus[cpu], &h);
+    }
+    if (ret == -EBUSY) {
+      busy_ns = min(busy_ns, h.timestamp_ns);
+    }
+    if (!ret &&
+        ((*oldest_cpu < 0) || (h.timestamp_ns < oldest->timestamp_ns))) {
+      *oldest = h;
+      *oldest_cpu = cpu;
+    }
+  }
+
+  if ((*oldest_cpu >= 0) && (oldest->timestamp_ns < busy_ns)) {
+    return 0;
+  }
+
+  return (busy_ns != U64_MAX) ? -EBUSY : -ENODATA;
+}
+
+/*a reader would get something, or at least make progress*/
+static bool pcd_log_ready(struct pcd_log *log) {
+  struct pcd_log_head h;
+  u64 busy_ns = U64_MAX, oldest_ns = U64_MAX;
+  int cpu, ret;
+
+  for_each_possible_cpu(cpu) {
+    ret = pcd_log_peek(log, log->cpus[cpu], &h);
+    if (ret == -EAGAIN) {
+      return true;
+    }
+    if (ret == -EBUSY) {
+      busy_ns = min(busy_ns, h.timestamp_ns);
+    } else if (!ret) {
+      oldest_ns = min(oldest_ns, h.timestamp_ns);
+    }
+  }
+
+  return (oldest_ns != U64_MAX) && (oldest_ns < busy_ns);
+}
+
+static ssize_t pcd_log_copy_out(struct pcd_log *log, char __user *buff,
+                                size_t count) {
+  struct pcd_log_entry entry;
+  struct pcd_log_head h;
+  size_t done = 0, size;
+  int cpu;
+
+  while (!pcd_log_next(log, &h, &cpu)) {
+    size = sizeof(entry) + ALIGN(h.len, 8);
+    if (done + size > count) {
+      /*like inotify, a buffer too small for the next entry is an error*/
+      return done ? done : -EINVAL;
+    }
+
+    entry.timestamp_ns = h.timestamp_ns;
+    entry.cpu = cpu;
+    entry.len = h.len;
+    /*the padding comes from the ring, where it is zero*/
+    if (copy_to_user(buff + done, &entry, sizeof(entry)) ||
+        copy_to_user(buff + done + sizeof(entry), h.rec + 1,
+                     ALIGN(h.len, 8))) {
+      return done ? done : -EFAULT;
+    }
+
+    pcd_log_consume(log->cpus[cpu], &h);
+    done += size;
+  }
+
+  return done;
+}
+
+/*consume the merged stream, blocks unless O_NONBLOCK while it is empty*/
+ssize_t pcd_log_read(struct pcdev_private_data *pcdev_data,
+                     struct file *filep, char __user *buff, size_t count) {
+  struct pcd_log *log = &pcdev_data->log;
+  ssize_t ret;
+
+  for (;;) {
+    if (mutex_lock_interruptible(&log->read_lock)) {
+      return -ERESTARTSYS;
+    }
+    ret = pcd_log_copy_out(log, buff, count);
+    mutex_unlock(&log->read_lock);
+    if (ret) {
+      return ret;
+    }
+
+    if (filep->f_flags & O_NONBLOCK) {
+      return -EAGAIN;
+    }
+    if (wait_event_interruptible(pcdev_data->wq, pcd_log_ready(log))) {
+      return -ERESTARTSYS;
+    }
+  }
+}
+
+__poll_t pcd_log_poll(struct pcdev_private_data *pcdev_data) {
+  return pcd_log_ready(&pcdev_data->log) ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+/*map the ring of one CPU, selected by the offset*/
+int pcd_log_mmap(struct pcd_log *log, struct vm_area_struct *vma) {
+  unsigned long ring_pages = (PAGE_SIZE + log->size) >> PAGE_SHIFT;
+  unsigned long cpu = vma->vm_pgoff / ring_pages;
+
+  if ((vma->vm_pgoff % ring_pages) || (cpu >= nr_cpu_ids) ||
+      !log->cpus[cpu] || (vma_pages(vma) != ring_pages)) {
+    return -EINVAL;
+  }
+
+  return remap_vmalloc_range(vma, log->cpus[cpu], 0);
+}
@@ -0,0 +1,260 @@
+#ifndef PCD_M_H
+#define PCD_M_H
+#include <linux/bitmap.h>
+#include <linux/blk-mq.h>
+#include <linux/cdev.h>
+#include <linux/device.h>
+#include <linux/fs.h>
+#include <linux/highmem.h>
+#include <linux/kdev_t.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/rwsem.h>
+#include <linux/uaccess.h>
+#include <linux/version.h>
+#include <linux/wait.h>
+
+#include "pcd_core.h"
+#include "pcd_ioctl.h"
+
+#undef pr_fmt
+#define pr_fmt(fmt) "%s :" fmt, __func__
+
+#define NO_OF_DEVICES 4
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 11, 0)
+/*no kmap_local on the board kernel, kmap_atomic maps the same way but
+ * without page faults, nothing may copy from or to user space under it*/
+#define kmap_local_page(page) kmap_atomic(page)
+#define kunmap_local(addr) kunmap_atomic(addr)
+#endif
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 1, 0)
+/*iov_iter directions before they got their own names*/
+#define ITER_SOURCE WRITE
+#define ITER_DEST READ
+#endif
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 19, 0)
+/*the dirty bitmap goes out as __u64 words on every arch*/
+#define BITS_TO_U64(nr) DIV_ROUND_UP(nr, 64)
+
+static inline void bitmap_to_arr64(u64 *buf, const unsigned long *bitmap,
+                                   unsigned int nbits) {
+  unsigned int i;
+
+  memset(buf, 0, BITS_TO_U64(nbits) * sizeof(u64));
+  for_each_set_bit(i, bitmap, nbits) {
+    buf[i / 64] |= BIT_ULL(i % 64);
+  }
+}
+#endif
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 12, 0)
+static inline void memzero_page(struct page *page, size_t offset,
+                                size_t len) {
+  void *addr = kmap_local_page(page);
+
+  memset(addr + offset, 0, len);
+  kunmap_local(addr);
+}
+#endif
+
+/*File access modes*/
+#define RDONLY 0x01
+#define WRONLY 0x10
+#define RDWR 0x11
+
+/*Device modes, set with the modes parameter*/
+#define PCD_MODE_BUFFER 0
+#define PCD_MODE_LOG 1
+#define PCD_MODE_RING 2
+
+/*Sparse, page backed device memory. Pages are allocated on first write and
+ * holes read back as zeros*/
+struct pcd_store {
+  struct page **pages;
+  unsigned long nr_pages;
+  size_t size;
+  /*one bit per page changed since the last PCD_IOC_DIRTY*/
+  unsigned long *dirty;
+  atomic64_t dirty_epoch;
+  /*live dma-buf exports, pages can't be punched while there are any*/
+  atomic_t exports;
+  /*crc32c of each page, trusted while its csum_valid bit is set*/
+  u32 *csums;
+  unsigned long *csum_valid;
+  /*every page allocated at load time, holes are never punched*/
+  bool populated;
+};
+
+/*stripes of a device's range lock, one bit of a u64 mask each*/
+#define PCD_LOCK_STRIPES 64
+
+struct pcd_range_lock {
+  struct rw_semaphore stripes[PCD_LOCK_STRIPES];
+};
+
+/*Per-CPU append only rings of a log mode device*/
+struct pcd_log {
+  /*bytes of records in each ring, a power of two*/
+  size_t size;
+  /*nr_cpu_ids entries, a control page followed by the records*/
+  struct pcd_log_ctrl **cpus;
+  /*serializes readers, writers never take it*/
+  struct mutex read_lock;
+};
+
+/*Broadcast ring, one writer and a cursor per open file*/
+struct pcd_ring {
+  char *buf;
+  /*a power of two*/
+  size_t size;
+  /*bytes written so far, and bytes the writer may be overwriting*/
+  atomic64_t head;
+  atomic64_t reserve;
+  atomic_t writers;
+  struct mutex write_lock;
+};
+
+/*Device private data structure*/
+struct pcdev_private_data {
+  int mode;
+  /*device memory, one of them depending on the mode*/
+  struct pcd_store store;
+  struct pcd_log log;
+  struct pcd_ring ring;
+  unsigned size;
+  const char *serial_number;
+  int perm;
+  struct cdev cdev;
+  /*serializes overlapping accesses to the device memory*/
+  struct pcd_range_lock rlock;
+  /*bumped on every change of the contents, readers poll for it*/
+  atomic64_t write_gen;
+  wait_queue_head_t wq;
+  struct fasync_struct *fasync;
+  /*block frontend, disk is NULL unless pcd_m_blk exposed the device*/
+  struct blk_mq_tag_set tag_set;
+  struct gendisk *disk;
+};
+
+/*Per open file data, the generation this reader has last seen and in ring
+ * mode where it reads next*/
+struct pcd_file {
+  struct pcdev_private_data *pcdev_data;
+  u64 seen_gen;
+  struct mutex cursor_lock;
+  u64 cursor;
+};
+
+/*Driver private data structure*/
+struct pcdrv_private_data {
+  int total_devices;
+  dev_t device_number;
+  struct class *class_pcd;
+  struct device *device_pcd;
+  struct pcdev_private_data pcdev_data[NO_OF_DEVICES];
+};
+
+struct dma_buf;
+
+extern struct file_operations pcd_fops;
+
+loff_t pcd_llseek(struct file *filep, loff_t offset, int whence);
+
+ssize_t pcd_read(struct file *filep, char __user *buff, size_t count,
+                 loff_t *f_pos);
+
+ssize_t pcd_write(struct file *filep, const char __user *buff, size_t count,
+                  loff_t *f_pos);
+
+int pcd_open(struct inode *inode, struct file *filep);
+
+int pcd_release(struct inode *inode, struct file *filep);
+
+__poll_t pcd_poll(struct file *filep, struct poll_table_struct *wait);
+
+int pcd_fasync(int fd, struct file *filep, int on);
+
+int pcd_mmap(struct file *filep, struct vm_area_struct *vma);
+
+long pcd_ioctl(struct file *filep, unsigned int cmd, unsigned long arg);
+
+void pcd_notify(struct pcdev_private_data *pcdev_data);
+
+void pcd_store_search(struct pcd_store *store, struct pcd_search *args,
+                      const u8 *pattern, u64 *matches);
+
+int pcd_csum_init(void);
+void pcd_csum_exit(void);
+int pcd_store_checksum(struct pcd_store *store, struct pcd_checksum *args);
+
+struct dma_buf *pcd_dmabuf_export(struct pcdev_private_data *pcdev_data);
+
+int pcd_log_init(struct pcd_log *log, size_t size);
+void pcd_log_free(struct pcd_log *log);
+ssize_t pcd_log_read(struct pcdev_private_data *pcdev_data,
+                     struct file *filep, char __user *buff, size_t count);
+ssize_t pcd_log_write(struct pcdev_private_data *pcdev_data,
+                      const char __user *buff, size_t count);
+__poll_t pcd_log_poll(struct pcdev_private_data *pcdev_data);
+int pcd_log_mmap(struct pcd_log *log, struct vm_area_struct *vma);
+
+int pcd_ring_init(struct pcd_ring *ring, size_t size);
+void pcd_ring_free(struct pcd_ring *ring);
+int pcd_ring_open(struct pcdev_private_data *pcdev_data,
+                  struct pcd_file *pfile, struct file *filep);
+void pcd_ring_release(struct pcdev_private_data *pcdev_data,
+                      struct file *filep);
+ssize_t pcd_ring_read(struct pcdev_private_data *pcdev_data,
+                      struct pcd_file *pfile, struct file *filep,
+                      char __user *buff, size_t count);
+ssize_t pcd_ring_write(struct pcdev_private_data *pcdev_data,
+                       const char __user *buff, size_t count);
+__poll_t pcd_ring_poll(struct pcdev_private_data *pcdev_data,
+                       struct pcd_file *pfile);
+
+int pcd_blk_init(struct pcdrv_private_data *pcdrv);
+void pcd_blk_exit(struct pcdrv_private_data *pcdrv);
+
+void pcd_range_lock_init(struct pcd_range_lock *rl);
+void pcd_range_lock(struct pcd_range_lock *rl, loff_t pos, size_t len,
+                    bool write, int subclass);
+void pcd_range_unlock(struct pcd_range_lock *rl, loff_t pos, size_t len,
+                      bool write);
+
+/*whole device, exclusive, for operations that touch every page*/
+static inline void pcd_lock_all(struct pcd_range_lock *rl) {
+  pcd_range_lock(rl, 0, SIZE_MAX, true, 0);
+}
+
+static inline void pcd_unlock_all(struct pcd_range_lock *rl) {
+  pcd_range_unlock(rl, 0, SIZE_MAX, true);
+}
+
+/*page store, callers hold the range lock for the pages they touch, except
+ * for pcd_store_atomic*/
+int pcd_store_init(struct pcd_store *store, size_t size);
+void pcd_store_free(struct pcd_store *store);
+int pcd_store_populate(struct pcd_store *store);
+ssize_t pcd_store_read(struct pcd_store *store, struct iov_iter *iter,
+                       loff_t pos);
+ssize_t pcd_store_write(struct pcd_store *store, struct iov_iter *iter,
+                        loff_t pos);
+int pcd_store_copy(struct pcd_store *dst, loff_t dst_pos,
+                   struct pcd_store *src, loff_t src_pos, size_t len);
+void pcd_store_zero(struct pcd_store *store, loff_t pos, size_t len,
+                    bool punch);
+int pcd_store_atomic(struct pcd_store *store, struct pcd_atomic *args);
+void pcd_store_mark_dirty(struct pcd_store *store, pgoff_t index);
+int pcd_store_pin_pages(struct pcd_store *store, struct page **pages);
+void pcd_store_unpin_pages(struct pcd_store *store, struct page **pages);
+int pcd_store_walk(struct pcd_store *store, loff_t pos, size_t len,
+                   int (*fn)(void *ctx, const void *data, size_t len),
+                   void *ctx);
+int pcd_store_dirty_fetch(struct pcd_store *store, u64 __user *ubitmap,
+                          u64 *epoch);
+
+#endif
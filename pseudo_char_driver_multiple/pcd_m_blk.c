@@ -0,0 +1,253 @@
+#include <linux/blk-mq.h>
+#include <linux/blkdev.h>
+#include <linux/version.h>
+
+#include "pcd_m.h"
+
+/*
+ * Optional blk-mq frontend, /dev/pcdblkN serves the same pages as
+ * /dev/pcdev-N. Requests take the range lock of the device like read() and
+ * write() do, and requests to disjoint ranges run in parallel.
+ *
+ * Buffered block I/O goes through the page cache of the block device, which
+ * the char device knows nothing about. Only O_DIRECT access to /dev/pcdblkN
+ * sees writes through /dev/pcdev-N and the other way around.
+ *
+ * The frontend needs 6.0 or later, where a blk_mq_alloc_disk disk is freed
+ * by put_disk alone. On older kernels, the 5.10 board among them, blkdev=1
+ * fails the load.
+ */
+
+static bool blkdev;
+module_param(blkdev, bool, 0444);
+MODULE_PARM_DESC(blkdev, "also expose the devices as /dev/pcdblkN");
+
+static unsigned int blk_queue_depth = 128;
+module_param(blk_queue_depth, uint, 0444);
+MODULE_PARM_DESC(blk_queue_depth, "tags per hardware queue");
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 0, 0)
+static int pcd_blk_major;
+
+static const struct block_device_operations pcd_blk_fops = {
+    .owner = THIS_MODULE,
+};
+
+static blk_status_t pcd_blk_rw(struct pcdev_private_data *pcdev_data,
+                               struct request *rq, loff_t pos) {
+  bool write = req_op(rq) == REQ_OP_WRITE;
+  struct req_iterator iter;
+  struct iov_iter bv_iter;
+  struct bio_vec bvec;
+  ssize_t ret;
+
+  rq_for_each_segment(bvec, rq, iter) {
+    iov_iter_bvec(&bv_iter, write ? ITER_SOURCE : ITER_DEST, &bvec, 1,
+                  bvec.bv_len);
+    ret = write ? pcd_store_write(&pcdev_data->store, &bv_iter, pos)
+                : pcd_store_read(&pcdev_data->store, &bv_iter, pos);
+    if (ret < 0) {
+      return errno_to_blk_status(ret);
+    }
+    if (ret != bvec.bv_len) {
+      return BLK_STS_IOERR;
+    }
+    pos += bvec.bv_len;
+  }
+
+  return BLK_STS_OK;
+}
+
+static blk_status_t pcd_blk_queue_rq(struct blk_mq_hw_ctx *hctx,
+                                     const struct blk_mq_queue_data *bd) {
+  struct pcdev_private_data *pcdev_data = hctx->queue->queuedata;
+  struct request *rq = bd->rq;
+  loff_t pos = (loff_t)blk_rq_pos(rq) << SECTOR_SHIFT;
+  bool write = op_is_write(req_op(rq));
+  blk_status_t status = BLK_STS_OK;
+
+  blk_mq_start_request(rq);
+
+  if (pos + blk_rq_bytes(rq) > pcdev_data->size) {
+    blk_mq_end_request(rq, BLK_STS_IOERR);
+    return BLK_STS_OK;
+  }
+
+  pcd_range_lock(&pcdev_data->rlock, pos, blk_rq_bytes(rq), write, 0);
+  switch (req_op(rq)) {
+  case REQ_OP_READ:
+  case REQ_OP_WRITE:
+    status = pcd_blk_rw(pcdev_data, rq, pos);
+    break;
+  case REQ_OP_DISCARD:
+    pcd_store_zero(&pcdev_data->store, pos, blk_rq_bytes(rq), true);
+    break;
+  case REQ_OP_WRITE_ZEROES:
+    /*REQ_NOUNMAP asks for the memory to stay allocated*/
+    pcd_store_zero(&pcdev_data->store, pos, blk_rq_bytes(rq),
+                   !(rq->cmd_flags & REQ_NOUNMAP));
+    break;
+  case REQ_OP_FLUSH:
+    break;
+  default:
+    status = BLK_STS_NOTSUPP;
+    break;
+  }
+  pcd_range_unlock(&pcdev_data->rlock, pos, blk_rq_bytes(rq), write);
+
+  if ((status == BLK_STS_OK) && write) {
+    pcd_notify(pcdev_data);
+  }
+
+  blk_mq_end_request(rq, status);
+  return BLK_STS_OK;
+}
+
+static const struct blk_mq_ops pcd_blk_mq_ops = {
+    .queue_rq = pcd_blk_queue_rq,
+};
+
+static int pcd_blk_add(struct pcdev_private_data *pcdev_data, int index) {
+  struct blk_mq_tag_set *set = &pcdev_data->tag_set;
+  struct gendisk *disk;
+  int ret;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 9, 0)
+  struct queue_limits lim = {
+      .logical_block_size = SECTOR_SIZE,
+      .max_hw_discard_sectors = UINT_MAX >> SECTOR_SHIFT,
+      .max_write_zeroes_sectors = UINT_MAX >> SECTOR_SHIFT,
+      .discard_granularity = PAGE_SIZE,
+  };
+#endif
+
+  /*one hardware queue per CPU, queue_rq sleeps on the range lock*/
+  set->ops = &pcd_blk_mq_ops;
+  set->nr_hw_queues = num_possible_cpus();
+  set->queue_depth = blk_queue_depth;
+  set->numa_node = NUMA_NO_NODE;
+  set->flags = BLK_MQ_F_BLOCKING;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 14, 0)
+  set->flags |= BLK_MQ_F_SHOULD_MERGE;
+#endif
+
+  ret = blk_mq_alloc_tag_set(set);
+  if (ret) {
+    return ret;
+  }
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 9, 0)
+  disk = blk_mq_alloc_disk(set, &lim, pcdev_data);
+#else
+  disk = blk_mq_alloc_disk(set, pcdev_data);
+#endif
+  if (IS_ERR(disk)) {
+    ret = PTR_ERR(disk);
+    goto free_tag_set;
+  }
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 9, 0)
+  blk_queue_logical_block_size(disk->queue, SECTOR_SIZE);
+  blk_queue_max_discard_sectors(disk->queue, UINT_MAX >> SECTOR_SHIFT);
+  blk_queue_max_write_zeroes_sectors(disk->queue, UINT_MAX >> SECTOR_SHIFT);
+  disk->queue->limits.discard_granularity = PAGE_SIZE;
+#endif
+
+  disk->major = pcd_blk_major;
+  disk->first_minor = index;
+  disk->minors = 1;
+  disk->fops = &pcd_blk_fops;
+  disk->flags |= GENHD_FL_NO_PART;
+  snprintf(disk->disk_name, DISK_NAME_LEN, "pcdblk%d", index);
+  set_capacity(disk, pcdev_data->size >> SECTOR_SHIFT);
+  if (pcdev_data->perm == RDONLY) {
+    set_disk_ro(disk, true);
+  }
+
+  ret = add_disk(disk);
+  if (ret) {
+    goto put_disk;
+  }
+
+  pcdev_data->disk = disk;
+  return 0;
+
+put_disk:
+  put_disk(disk);
+free_tag_set:
+  blk_mq_free_tag_set(set);
+  return ret;
+}
+
+static void pcd_blk_del(struct pcdev_private_data *pcdev_data) {
+  if (!pcdev_data->disk) {
+    return;
+  }
+
+  del_gendisk(pcdev_data->disk);
+  put_disk(pcdev_data->disk);
+  blk_mq_free_tag_set(&pcdev_data->tag_set);
+  pcdev_data->disk = NULL;
+}
+
+void pcd_blk_exit(struct pcdrv_private_data *pcdrv) {
+  int i;
+
+  if (!pcd_blk_major) {
+    return;
+  }
+
+  for (i = 0; i < NO_OF_DEVICES; i++) {
+    pcd_blk_del(&pcdrv->pcdev_data[i]);
+  }
+  unregister_blkdev(pcd_blk_major, "pcdblk");
+  pcd_blk_major = 0;
+}
+
+int pcd_blk_init(struct pcdrv_private_data *pcdrv) {
+  int ret, i;
+
+  if (!blkdev) {
+    return 0;
+  }
+
+  if (!blk_queue_depth || blk_queue_depth > BLK_MQ_MAX_DEPTH) {
+    pr_err("blk_queue_depth must be between 1 and %d\n", BLK_MQ_MAX_DEPTH);
+    return -EINVAL;
+  }
+
+  ret = register_blkdev(0, "pcdblk");
+  if (ret < 0) {
+    pr_err("could not register block major\n");
+    return ret;
+  }
+  pcd_blk_major = ret;
+
+  for (i = 0; i < NO_OF_DEVICES; i++) {
+    /*a block device can't be write only or a stream, those stay char only*/
+    if (!(pcdrv->pcdev_data[i].perm & RDONLY) ||
+        (pcdrv->pcdev_data[i].mode != PCD_MODE_BUFFER)) {
+      continue;
+    }
+
+    ret = pcd_blk_add(&pcdrv->pcdev_data[i], i + 1);
+    if (ret) {
+      pr_err("pcdblk%d couldn't be created\n", i + 1);
+      pcd_blk_exit(pcdrv);
+      return ret;
+    }
+  }
+
+  return 0;
+}
+#else
+void pcd_blk_exit(struct pcdrv_private_data *pcdrv) {}
+
+int pcd_blk_init(struct pcdrv_private_data *pcdrv) {
+  if (!blkdev) {
+    return 0;
+  }
+
+  pr_err("blkdev needs a 6.0 or later kernel\n");
+  return -EOPNOTSUPP;
+}
+#endif
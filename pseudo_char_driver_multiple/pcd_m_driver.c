@@ -0,0 +1,210 @@
+#include "pcd_m.h"
+
+#define MEM_SIZE_MAX_PCDEV1 1024
+#define MEM_SIZE_MAX_PCDEV2 512
+#define MEM_SIZE_MAX_PCDEV3 1024
+#define MEM_SIZE_MAX_PCDEV4 512
+
+/*largest device size accepted through the sizes parameter*/
+#define MEM_SIZE_LIMIT (1U << 30)
+
+/*pseudo device's memory size, pages are only allocated once written*/
+static unsigned int sizes[NO_OF_DEVICES] = {
+    MEM_SIZE_MAX_PCDEV1, MEM_SIZE_MAX_PCDEV2, MEM_SIZE_MAX_PCDEV3,
+    MEM_SIZE_MAX_PCDEV4};
+module_param_array(sizes, uint, NULL, 0444);
+MODULE_PARM_DESC(sizes, "size in bytes of pcdev-1..4");
+
+/*for real time use, page allocation is kept out of the write path*/
+static bool populate;
+module_param(populate, bool, 0444);
+MODULE_PARM_DESC(populate, "allocate all device memory at load time");
+
+/*buffer when not given, a log device's size is the size of each CPU's ring
+ * and a ring device's the size of its ring*/
+static char *modes[NO_OF_DEVICES];
+module_param_array(modes, charp, NULL, 0444);
+MODULE_PARM_DESC(modes, "mode of pcdev-1..4, buffer, log or ring");
+
+struct pcdrv_private_data pcdrv_data = {
+    .total_devices = NO_OF_DEVICES,
+    .pcdev_data = {[0] = {.serial_number = "PCDEV1", .perm = RDONLY},
+                   [1] = {.serial_number = "PCDEV2", .perm = WRONLY},
+                   [2] = {.serial_number = "PCDEV3", .perm = RDWR},
+                   [3] = {.serial_number = "PCDEV4", .perm = RDWR}}};
+
+/*file ops of the driver*/
+struct file_operations pcd_fops = {.open = pcd_open,
+                                   .write = pcd_write,
+                                   .read = pcd_read,
+                                   .llseek = pcd_llseek,
+                                   .release = pcd_release,
+                                   .poll = pcd_poll,
+                                   .mmap = pcd_mmap,
+                                   .fasync = pcd_fasync,
+                                   .unlocked_ioctl = pcd_ioctl,
+                                   .compat_ioctl = compat_ptr_ioctl,
+                                   .owner = THIS_MODULE};
+
+static void pcd_devices_free(void) {
+  int i;
+
+  for (i = 0; i < NO_OF_DEVICES; i++) {
+    pcd_store_free(&pcdrv_data.pcdev_data[i].store);
+    pcd_log_free(&pcdrv_data.pcdev_data[i].log);
+    pcd_ring_free(&pcdrv_data.pcdev_data[i].ring);
+  }
+}
+
+static int pcd_parse_mode(const char *mode) {
+  if (!mode || !strcmp(mode, "buffer")) {
+    return PCD_MODE_BUFFER;
+  }
+  if (!strcmp(mode, "log")) {
+    return PCD_MODE_LOG;
+  }
+  if (!strcmp(mode, "ring")) {
+    return PCD_MODE_RING;
+  }
+  return -EINVAL;
+}
+
+static int __init pcd_driver_init(void) {
+
+  int ret, i;
+
+  for (i = 0; i < NO_OF_DEVICES; i++) {
+    if (!sizes[i] || sizes[i] > MEM_SIZE_LIMIT) {
+      pr_err("invalid size for pcdev-%d\n", i + 1);
+      ret = -EINVAL;
+      goto free_devices;
+    }
+
+    ret = pcd_parse_mode(modes[i]);
+    if (ret < 0) {
+      pr_err("invalid mode for pcdev-%d\n", i + 1);
+      goto free_devices;
+    }
+
+    pcdrv_data.pcdev_data[i].mode = ret;
+    pcdrv_data.pcdev_data[i].size = sizes[i];
+    if (pcdrv_data.pcdev_data[i].mode == PCD_MODE_LOG) {
+      ret = pcd_log_init(&pcdrv_data.pcdev_data[i].log, sizes[i]);
+    } else if (pcdrv_data.pcdev_data[i].mode == PCD_MODE_RING) {
+      ret = pcd_ring_init(&pcdrv_data.pcdev_data[i].ring, sizes[i]);
+    } else {
+      ret = pcd_store_init(&pcdrv_data.pcdev_data[i].store, sizes[i]);
+      if (!ret && populate) {
+        ret = pcd_store_populate(&pcdrv_data.pcdev_data[i].store);
+      }
+    }
+    if (ret) {
+      pr_err("cannot allocate memory for pcdev-%d\n", i + 1);
+      goto free_devices;
+    }
+    pcd_range_lock_init(&pcdrv_data.pcdev_data[i].rlock);
+    atomic64_set(&pcdrv_data.pcdev_data[i].write_gen, 0);
+    init_waitqueue_head(&pcdrv_data.pcdev_data[i].wq);
+  }
+
+  ret = pcd_csum_init();
+  if (ret) {
+    goto free_devices;
+  }
+
+  /*Dynamically allocate a device numbers*/
+  ret = alloc_chrdev_region(&pcdrv_data.device_number, 0, NO_OF_DEVICES,
+                            "pcd_devices");
+  if (ret < 0) {
+    pr_err("could not allocate device number\n");
+    goto csum_exit;
+  }
+
+  /*Create device class under /sys/class, class_create lost its owner
+   * parameter in 6.4*/
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+  pcdrv_data.class_pcd = class_create("pcd_m_class");
+#else
+  pcdrv_data.class_pcd = class_create(THIS_MODULE, "pcd_m_class");
+#endif
+  if (IS_ERR(pcdrv_data.class_pcd)) {
+    pr_err("Class creation failed\n");
+    ret = PTR_ERR(pcdrv_data.class_pcd);
+    goto unreg_chrdev;
+  }
+
+  for (i = 0; i < NO_OF_DEVICES; i++) {
+    pr_info("Device number <major>:<minor> = %d:%d\n",
+            MAJOR(pcdrv_data.device_number + i),
+            MINOR(pcdrv_data.device_number + i));
+
+    /*Initialize the cdev structure with fops*/
+    cdev_init(&pcdrv_data.pcdev_data[i].cdev, &pcd_fops);
+
+    /*Register a device (cdev structure) with VFS*/
+    pcdrv_data.pcdev_data[i].cdev.owner = THIS_MODULE;
+    ret = cdev_add(&pcdrv_data.pcdev_data[i].cdev, pcdrv_data.device_number + i,
+                   1);
+    if (ret < 0) {
+      pr_err("device couldn't created\n");
+      goto cdev_del;
+    }
+
+    /*populate the sysfs with device information*/
+    pcdrv_data.device_pcd =
+        device_create(pcdrv_data.class_pcd, NULL, pcdrv_data.device_number + i,
+                      NULL, "pcdev-%d", i + 1);
+    if (IS_ERR(pcdrv_data.device_pcd)) {
+      pr_err("Device creation failed\n");
+      ret = PTR_ERR(pcdrv_data.device_pcd);
+      cdev_del(&pcdrv_data.pcdev_data[i].cdev);
+      goto cdev_del;
+    }
+  }
+
+  ret = pcd_blk_init(&pcdrv_data);
+  if (ret) {
+    goto cdev_del;
+  }
+
+  pr_info("Module init was successul\n");
+
+  return 0;
+
+cdev_del:
+  /*unwind the devices that were fully set up*/
+  for (i--; i >= 0; i--) {
+    device_destroy(pcdrv_data.class_pcd, pcdrv_data.device_number + i);
+    cdev_del(&pcdrv_data.pcdev_data[i].cdev);
+  }
+  class_destroy(pcdrv_data.class_pcd);
+unreg_chrdev:
+  unregister_chrdev_region(pcdrv_data.device_number, NO_OF_DEVICES);
+csum_exit:
+  pcd_csum_exit();
+free_devices:
+  pcd_devices_free();
+  pr_err("module insertion failed\n");
+  return ret;
+}
+
+static void __exit pcd_driver_cleanup(void) {
+  int i;
+  pcd_blk_exit(&pcdrv_data);
+  for (i = 0; i < NO_OF_DEVICES; i++) {
+    device_destroy(pcdrv_data.class_pcd, pcdrv_data.device_number + i);
+    cdev_del(&pcdrv_data.pcdev_data[i].cdev);
+  }
+  class_destroy(pcdrv_data.class_pcd);
+  unregister_chrdev_region(pcdrv_data.device_number, NO_OF_DEVICES);
+  pcd_csum_exit();
+  pcd_devices_free();
+  pr_info("module unloaded\n");
+}
+
+module_init(pcd_driver_init);
+module_exit(pcd_driver_cleanup);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Yusuf Atalay");
+MODULE_DESCRIPTION("A pseudo character device driver which handles 4 devices");
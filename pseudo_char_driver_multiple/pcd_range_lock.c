@@ -0,0 +1,78 @@
+#include "pcd_m.h"
+
+/*
+ * Byte range locking by page stripes. Page N of a device is covered by
+ * stripe N % PCD_LOCK_STRIPES, a range takes the stripes of all its pages,
+ * shared for readers and exclusive for writers, always in ascending stripe
+ * order. Accesses to disjoint pages in different stripes run in parallel,
+ * overlapping ones serialize on their common stripes.
+ */
+
+/*every stripe gets its own lockdep class, a range legitimately holds
+ * several of them at once*/
+static struct lock_class_key pcd_stripe_keys[PCD_LOCK_STRIPES];
+
+void pcd_range_lock_init(struct pcd_range_lock *rl) {
+  int i;
+
+  for (i = 0; i < PCD_LOCK_STRIPES; i++) {
+    init_rwsem(&rl->stripes[i]);
+    lockdep_set_class(&rl->stripes[i], &pcd_stripe_keys[i]);
+  }
+}
+
+static u64 pcd_range_stripes(loff_t pos, size_t len) {
+  pgoff_t first, last, index;
+  u64 mask = 0;
+
+  if (!len) {
+    return 0;
+  }
+
+  first = pos >> PAGE_SHIFT;
+  last = (pos + len - 1) >> PAGE_SHIFT;
+  if (last - first >= PCD_LOCK_STRIPES - 1) {
+    return U64_MAX;
+  }
+
+  for (index = first; index <= last; index++) {
+    mask |= BIT_ULL(index % PCD_LOCK_STRIPES);
+  }
+
+  return mask;
+}
+
+/*subclass is SINGLE_DEPTH_NESTING for the second device of a copy*/
+void pcd_range_lock(struct pcd_range_lock *rl, loff_t pos, size_t len,
+                    bool write, int subclass) {
+  u64 mask = pcd_range_stripes(pos, len);
+  int i;
+
+  for (i = 0; i < PCD_LOCK_STRIPES; i++) {
+    if (!(mask & BIT_ULL(i))) {
+      continue;
+    }
+    if (write) {
+      down_write_nested(&rl->stripes[i], subclass);
+    } else {
+      down_read_nested(&rl->stripes[i], subclass);
+    }
+  }
+}
+
+void pcd_range_unlock(struct pcd_range_lock *rl, loff_t pos, size_t len,
+                      bool write) {
+  u64 mask = pcd_range_stripes(pos, len);
+  int i;
+
+  for (i = PCD_LOCK_STRIPES - 1; i >= 0; i--) {
+    if (!(mask & BIT_ULL(i))) {
+      continue;
+    }
+    if (write) {
+      up_write(&rl->stripes[i]);
+    } else {
+      up_read(&rl->stripes[i]);
+    }
+  }
+}
@@ -0,0 +1,187 @@
+#include <linux/log2.h>
+#include <linux/vmalloc.h>
+
+#include "pcd_m.h"
+
+/*
+ * Broadcast mode, one writer appends a byte stream to a ring and every open
+ * file reads it from its own cursor. The writer never waits for readers.
+ * Before overwriting anything it moves reserve past the bytes it is about to
+ * write, and moves head once they are in place. A reader copies out below
+ * head and checks reserve afterwards, if the writer reserved more than a
+ * ring's worth past the reader's cursor the copy may be torn and the reader
+ * gets -EOVERFLOW instead.
+ */
+
+int pcd_ring_init(struct pcd_ring *ring, size_t size) {
+  ring->size = roundup_pow_of_two(max_t(size_t, size, PAGE_SIZE));
+  ring->buf = vmalloc(ring->size);
+  if (!ring->buf) {
+    return -ENOMEM;
+  }
+
+  atomic64_set(&ring->head, 0);
+  atomic64_set(&ring->reserve, 0);
+  atomic_set(&ring->writers, 0);
+  mutex_init(&ring->write_lock);
+
+  return 0;
+}
+
+void pcd_ring_free(struct pcd_ring *ring) {
+  vfree(ring->buf);
+  ring->buf = NULL;
+}
+
+/*one writer at a time, readers start with what is written after the open*/
+int pcd_ring_open(struct pcdev_private_data *pcdev_data,
+                  struct pcd_file *pfile, struct file *filep) {
+  struct pcd_ring *ring = &pcdev_data->ring;
+
+  if ((filep->f_mode & FMODE_WRITE) &&
+      (atomic_cmpxchg(&ring->writers, 0, 1) != 0)) {
+    return -EBUSY;
+  }
+
+  mutex_init(&pfile->cursor_lock);
+  pfile->cursor = atomic64_read(&ring->head);
+  return 0;
+}
+
+void pcd_ring_release(struct pcdev_private_data *pcdev_data,
+                      struct file *filep) {
+  if (filep->f_mode & FMODE_WRITE) {
+    atomic_set(&pcdev_data->ring.writers, 0);
+  }
+}
+
+/*copy len bytes between the ring at pos and a user buffer, split in two
+ * where the ring wraps. Returns the number of bytes not copied*/
+static size_t pcd_ring_copy(struct pcd_ring *ring, u64 pos, void __user *ubuf,
+                            size_t len, bool to_ring) {
+  size_t off = pos & (ring->size - 1);
+  size_t first = min(len, ring->size - off);
+  size_t left;
+
+  left = to_ring ? copy_from_user(ring->buf + off, ubuf, first)
+                 : copy_to_user(ubuf, ring->buf + off, first);
+  if (left || (first == len)) {
+    return left + len - first;
+  }
+
+  return to_ring ? copy_from_user(ring->buf, ubuf + first, len - first)
+                 : copy_to_user(ubuf + first, ring->buf, len - first);
+}
+
+ssize_t pcd_ring_write(struct pcdev_private_data *pcdev_data,
+                       const char __user *buff, size_t count) {
+  struct pcd_ring *ring = &pcdev_data->ring;
+  size_t left;
+  u64 head;
+
+  if (!count) {
+    return 0;
+  }
+  /*more than a ring would overwrite itself*/
+  count = min(count, ring->size);
+
+  /*the writer's file can still be shared between threads*/
+  if (mutex_lock_interruptible(&ring->write_lock)) {
+    return -ERESTARTSYS;
+  }
+
+  head = atomic64_read(&ring->head);
+  /*reserve only grows, a faulted write may have left it past head*/
+  if (head + count > atomic64_read(&ring->reserve)) {
+    atomic64_set(&ring->reserve, head + count);
+  }
+  /*readers must see the reservation before any byte is overwritten*/
+  smp_mb();
+
+  left = pcd_ring_copy(ring, head, (void __user *)buff, count, true);
+  count -= left;
+
+  /*the data before the new head*/
+  smp_wmb();
+  atomic64_set(&ring->head, head + count);
+  mutex_unlock(&ring->write_lock);
+
+  if (!count) {
+    return -EFAULT;
+  }
+  pcd_notify(pcdev_data);
+
+  return count;
+}
+
+static ssize_t pcd_ring_read_locked(struct pcdev_private_data *pcdev_data,
+                                    struct pcd_file *pfile,
+                                    struct file *filep, char __user *buff,
+                                    size_t count) {
+  struct pcd_ring *ring = &pcdev_data->ring;
+  u64 head, reserve;
+  size_t len;
+
+  for (;;) {
+    head = atomic64_read(&ring->head);
+    if (head != pfile->cursor) {
+      break;
+    }
+    if (filep->f_flags & O_NONBLOCK) {
+      return -EAGAIN;
+    }
+    if (wait_event_interruptible(pcdev_data->wq,
+                                 atomic64_read(&ring->head) != pfile->cursor)) {
+      return -ERESTARTSYS;
+    }
+  }
+  /*pairs with the smp_wmb before head moves*/
+  smp_rmb();
+
+  len = min_t(u64, count, head - pfile->cursor);
+  if (head - pfile->cursor <= ring->size) {
+    if (pcd_ring_copy(ring, pfile->cursor, buff, len, false)) {
+      return -EFAULT;
+    }
+  }
+
+  /*pairs with the smp_mb before the writer overwrites*/
+  smp_rmb();
+  reserve = atomic64_read(&ring->reserve);
+  if (reserve - pfile->cursor > ring->size) {
+    /*lost data, go on with the oldest byte that is still safe to read*/
+    pfile->cursor = reserve - ring->size;
+    return -EOVERFLOW;
+  }
+
+  pfile->cursor += len;
+  return len;
+}
+
+/*the bytes written since this file's cursor, -EOVERFLOW once when the
+ * writer overwrote some of them before they were read*/
+ssize_t pcd_ring_read(struct pcdev_private_data *pcdev_data,
+                      struct pcd_file *pfile, struct file *filep,
+                      char __user *buff, size_t count) {
+  ssize_t ret;
+
+  if (!count) {
+    return 0;
+  }
+
+  /*threads sharing the file share its cursor*/
+  if (mutex_lock_interruptible(&pfile->cursor_lock)) {
+    return -ERESTARTSYS;
+  }
+  ret = pcd_ring_read_locked(pcdev_data, pfile, filep, buff, count);
+  mutex_unlock(&pfile->cursor_lock);
+
+  return ret;
+}
+
+__poll_t pcd_ring_poll(struct pcdev_private_data *pcdev_data,
+                       struct pcd_file *pfile) {
+  return (atomic64_read(&pcdev_data->ring.head) != pfile->cursor)
+             ? EPOLLIN | EPOLLRDNORM
+             : 0;
+}
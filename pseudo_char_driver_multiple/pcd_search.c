@@ -0,0 +1,123 @@
+#include <linux/highmem.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+
+#include "pcd_m.h"
+
+/*
+ * Pattern search over the page store, in place. memchr finds candidates for
+ * the first byte of the pattern within one page, memcmp checks them, also
+ * across page boundaries. Holes are searched as the zero page, or skipped
+ * outright when the pattern doesn't start with a zero byte.
+ */
+
+/*does the store hold pattern at pos, the range may span pages*/
+static bool pcd_search_match(struct pcd_store *store, loff_t pos,
+                             const u8 *pattern, size_t len) {
+  size_t offset, chunk;
+  struct page *page;
+  bool match;
+  void *vaddr;
+
+  while (len) {
+    offset = offset_in_page(pos);
+    chunk = min_t(size_t, PAGE_SIZE - offset, len);
+
+    page = READ_ONCE(store->pages[pos >> PAGE_SHIFT]);
+    if (page) {
+      vaddr = kmap_local_page(page);
+      match = !memcmp(vaddr + offset, pattern, chunk);
+      kunmap_local(vaddr);
+    } else {
+      match = !memchr_inv(pattern, 0, chunk);
+    }
+    if (!match) {
+      return false;
+    }
+
+    pattern += chunk;
+    pos += chunk;
+    len -= chunk;
+  }
+
+  return true;
+}
+
+/*scan the candidates starting in [pos, end) of one page*/
+static void pcd_search_page(struct pcd_store *store, struct pcd_search *args,
+                            const u8 *pattern, u64 *matches, loff_t pos,
+                            loff_t end) {
+  size_t offset = offset_in_page(pos), len = end - pos, first;
+  struct page *page;
+  const u8 *data, *hit;
+  void *vaddr = NULL;
+
+  page = READ_ONCE(store->pages[pos >> PAGE_SHIFT]);
+  if (!page) {
+    if (pattern[0]) {
+      return;
+    }
+    data = page_address(ZERO_PAGE(0));
+  } else {
+    vaddr = kmap_local_page(page);
+    data = vaddr;
+  }
+
+  while (len) {
+    hit = memchr(data + offset, pattern[0], len);
+    if (!hit) {
+      break;
+    }
+
+    first = hit - data;
+    pos += first - offset;
+    len -= first - offset;
+    offset = first;
+
+    /*the part inside this page is compared here, the rest page by page*/
+    if (!memcmp(hit, pattern,
+                min_t(size_t, PAGE_SIZE - offset, args->pattern_len)) &&
+        ((offset + args->pattern_len <= PAGE_SIZE) ||
+         pcd_search_match(store, pos + PAGE_SIZE - offset,
+                          pattern + PAGE_SIZE - offset,
+                          args->pattern_len - (PAGE_SIZE - offset)))) {
+      matches[args->nr_matches++] = pos;
+      if (args->nr_matches == args->max_matches) {
+        args->next = pos + 1;
+        break;
+      }
+    }
+
+    pos++;
+    offset++;
+    len--;
+  }
+
+  if (vaddr) {
+    kunmap_local(vaddr);
+  }
+}
+
+/*caller holds the range lock, range and pattern are validated*/
+void pcd_store_search(struct pcd_store *store, struct pcd_search *args,
+                      const u8 *pattern, u64 *matches) {
+  loff_t pos = args->offset, end, page_end;
+
+  /*a match has to fit in the device*/
+  end = min_t(u64, args->offset + args->limit,
+              store->size - args->pattern_len + 1);
+
+  args->nr_matches = 0;
+  args->next = max_t(loff_t, pos, end);
+
+  while (pos < end) {
+    page_end = min_t(loff_t, round_down(pos, PAGE_SIZE) + PAGE_SIZE, end);
+    pcd_search_page(store, args, pattern, matches, pos, page_end);
+    if (args->nr_matches == args->max_matches) {
+      break;
+    }
+
+    pos = page_end;
+    cond_resched();
+  }
+}
@@ -0,0 +1,481 @@
+#include <linux/atomic.h>
+#include <linux/bitmap.h>
+#include <linux/highmem.h>
+#include <linux/mm.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+#include <linux/uio.h>
+
+#include "pcd_m.h"
+
+int pcd_store_init(struct pcd_store *store, size_t size) {
+  store->size = size;
+  store->nr_pages = DIV_ROUND_UP(size, PAGE_SIZE);
+  store->pages = kvcalloc(store->nr_pages, sizeof(*store->pages), GFP_KERNEL);
+  store->dirty = bitmap_zalloc(store->nr_pages, GFP_KERNEL);
+  store->csums = kvcalloc(store->nr_pages, sizeof(*store->csums), GFP_KERNEL);
+  store->csum_valid = bitmap_zalloc(store->nr_pages, GFP_KERNEL);
+  if (!store->pages || !store->dirty || !store->csums || !store->csum_valid) {
+    pcd_store_free(store);
+    return -ENOMEM;
+  }
+  atomic64_set(&store->dirty_epoch, 0);
+  atomic_set(&store->exports, 0);
+
+  return 0;
+}
+
+void pcd_store_free(struct pcd_store *store) {
+  unsigned long i;
+
+  if (store->pages) {
+    for (i = 0; i < store->nr_pages; i++) {
+      if (store->pages[i]) {
+        put_page(store->pages[i]);
+      }
+    }
+  }
+  kvfree(store->pages);
+  store->pages = NULL;
+  bitmap_free(store->dirty);
+  store->dirty = NULL;
+  kvfree(store->csums);
+  store->csums = NULL;
+  bitmap_free(store->csum_valid);
+  store->csum_valid = NULL;
+}
+
+/*record a changed page, after the data so a sync that clears the bit first
+ * either sees the new data or the bit again, the same goes for the cached
+ * checksum. Testing first keeps an already dirty page from bouncing the
+ * bitmap cache line on every write*/
+void pcd_store_mark_dirty(struct pcd_store *store, pgoff_t index) {
+  if (!test_bit(index, store->dirty)) {
+    set_bit(index, store->dirty);
+  }
+  /*the cached checksum of the page is stale now*/
+  if (test_bit(index, store->csum_valid)) {
+    clear_bit(index, store->csum_valid);
+  }
+}
+
+/*return the page backing index, a hole gets a zeroed page. Atomic ops fill
+ * holes without any lock, so a new page is only installed over NULL*/
+static struct page *pcd_store_get_page(struct pcd_store *store,
+                                       pgoff_t index) {
+  struct page *page, *old;
+
+  page = READ_ONCE(store->pages[index]);
+  if (page) {
+    return page;
+  }
+
+  page = alloc_page(GFP_HIGHUSER | __GFP_ZERO);
+  if (!page) {
+    return NULL;
+  }
+
+  old = cmpxchg(&store->pages[index], NULL, page);
+  if (old) {
+    /*somebody else filled the hole first*/
+    __free_page(page);
+    return old;
+  }
+
+  return page;
+}
+
+/*allocate every page up front, writes never allocate afterwards*/
+int pcd_store_populate(struct pcd_store *store) {
+  unsigned long i;
+
+  for (i = 0; i < store->nr_pages; i++) {
+    if (!pcd_store_get_page(store, i)) {
+      return -ENOMEM;
+    }
+  }
+  store->populated = true;
+
+  return 0;
+}
+
+/*pages taken out of the store are only freed once no atomic op can still be
+ * looking at them*/
+static void pcd_store_release(struct list_head *freed) {
+  struct page *page, *tmp;
+
+  if (list_empty(freed)) {
+    return;
+  }
+
+  synchronize_rcu();
+  list_for_each_entry_safe(page, tmp, freed, lru) {
+    list_del(&page->lru);
+    put_page(page);
+  }
+}
+
+/*copy to iter, user space for read() or a bio_vec for the block frontend.
+ * A fault ends the copy, the bytes copied until then are returned*/
+ssize_t pcd_store_read(struct pcd_store *store, struct iov_iter *iter,
+                       loff_t pos) {
+  size_t count = iov_iter_count(iter);
+  size_t done = 0, offset, chunk, copied;
+  struct page *page;
+
+  while (done < count) {
+    offset = offset_in_page(pos);
+    chunk = min_t(size_t, PAGE_SIZE - offset, count - done);
+
+    page = READ_ONCE(store->pages[pos >> PAGE_SHIFT]);
+    if (page) {
+      copied = copy_page_to_iter(page, offset, chunk, iter);
+    } else {
+      /*holes read back as zeros*/
+      copied = iov_iter_zero(chunk, iter);
+    }
+    done += copied;
+    if (copied != chunk) {
+      return done ? done : -EFAULT;
+    }
+
+    pos += chunk;
+  }
+
+  return done;
+}
+
+ssize_t pcd_store_write(struct pcd_store *store, struct iov_iter *iter,
+                        loff_t pos) {
+  size_t count = iov_iter_count(iter);
+  size_t done = 0, offset, chunk, copied;
+  struct page *page;
+
+  while (done < count) {
+    offset = offset_in_page(pos);
+    chunk = min_t(size_t, PAGE_SIZE - offset, count - done);
+
+    page = pcd_store_get_page(store, pos >> PAGE_SHIFT);
+    if (!page) {
+      return done ? done : -ENOMEM;
+    }
+
+    copied = copy_page_from_iter(page, offset, chunk, iter);
+    /*a partial copy may still have changed the page*/
+    if (copied) {
+      pcd_store_mark_dirty(store, pos >> PAGE_SHIFT);
+    }
+    done += copied;
+    if (copied != chunk) {
+      return done ? done : -EFAULT;
+    }
+
+    pos += chunk;
+  }
+
+  return done;
+}
+
+/*clear a range, pages it fully covers are moved to freed when punching*/
+static void __pcd_store_zero(struct pcd_store *store, loff_t pos, size_t len,
+                             bool punch, struct list_head *freed) {
+  size_t offset, chunk;
+  struct page *page;
+  pgoff_t index;
+
+  /*exported pages are shared with a dma-buf and populated stores keep
+   * every page, they can only be cleared*/
+  if (atomic_read(&store->exports) || store->populated) {
+    punch = false;
+  }
+
+  while (len) {
+    offset = offset_in_page(pos);
+    chunk = min_t(size_t, PAGE_SIZE - offset, len);
+    index = pos >> PAGE_SHIFT;
+
+    page = READ_ONCE(store->pages[index]);
+    if (page) {
+      /*the last page is fully covered once the range reaches the end*/
+      if (punch && !offset &&
+          ((chunk == PAGE_SIZE) || (pos + chunk >= store->size))) {
+        WRITE_ONCE(store->pages[index], NULL);
+        list_add(&page->lru, freed);
+      } else {
+        memzero_page(page, offset, chunk);
+      }
+      pcd_store_mark_dirty(store, index);
+    }
+
+    pos += chunk;
+    len -= chunk;
+  }
+}
+
+void pcd_store_zero(struct pcd_store *store, loff_t pos, size_t len,
+                    bool punch) {
+  LIST_HEAD(freed);
+
+  __pcd_store_zero(store, pos, len, punch, &freed);
+  pcd_store_release(&freed);
+}
+
+/*copy a chunk that stays within one page on both sides*/
+static int pcd_store_copy_chunk(struct pcd_store *dst, loff_t dst_pos,
+                                struct pcd_store *src, loff_t src_pos,
+                                size_t len, struct list_head *freed) {
+  struct page *src_page, *dst_page;
+  void *src_addr, *dst_addr;
+
+  src_page = READ_ONCE(src->pages[src_pos >> PAGE_SHIFT]);
+  if (!src_page) {
+    /*a hole is copied by clearing, or freeing, the destination*/
+    __pcd_store_zero(dst, dst_pos, len, true, freed);
+    return 0;
+  }
+
+  dst_page = pcd_store_get_page(dst, dst_pos >> PAGE_SHIFT);
+  if (!dst_page) {
+    return -ENOMEM;
+  }
+
+  /*map a page only once, memmove must see overlap within one mapping*/
+  src_addr = kmap_local_page(src_page);
+  dst_addr = dst_page == src_page ? src_addr : kmap_local_page(dst_page);
+  memmove(dst_addr + offset_in_page(dst_pos),
+          src_addr + offset_in_page(src_pos), len);
+  if (dst_addr != src_addr) {
+    kunmap_local(dst_addr);
+  }
+  kunmap_local(src_addr);
+  pcd_store_mark_dirty(dst, dst_pos >> PAGE_SHIFT);
+
+  return 0;
+}
+
+/*copy len bytes between two stores, or within one with memmove semantics*/
+int pcd_store_copy(struct pcd_store *dst, loff_t dst_pos,
+                   struct pcd_store *src, loff_t src_pos, size_t len) {
+  bool backward = (dst == src) && (dst_pos > src_pos) &&
+                  (dst_pos < src_pos + (loff_t)len);
+  LIST_HEAD(freed);
+  loff_t d, s;
+  size_t chunk;
+  int ret = 0;
+
+  if ((dst == src) && (dst_pos == src_pos)) {
+    return 0;
+  }
+
+  while (len) {
+    if (backward) {
+      /*walk down from the end so overlapping source bytes are read first*/
+      d = dst_pos + len;
+      s = src_pos + len;
+      chunk = min_t(size_t, len,
+                    min(offset_in_page(d - 1), offset_in_page(s - 1)) + 1);
+      d -= chunk;
+      s -= chunk;
+    } else {
+      d = dst_pos;
+      s = src_pos;
+      chunk = min_t(size_t, len,
+                    PAGE_SIZE - max(offset_in_page(d), offset_in_page(s)));
+      dst_pos += chunk;
+      src_pos += chunk;
+    }
+
+    ret = pcd_store_copy_chunk(dst, d, src, s, chunk, &freed);
+    if (ret) {
+      break;
+    }
+    len -= chunk;
+  }
+
+  pcd_store_release(&freed);
+  return ret;
+}
+
+static u64 pcd_atomic32(u32 *word, const struct pcd_atomic *args) {
+  u32 old;
+
+  switch (args->op) {
+  case PCD_ATOMIC_CAS:
+    return cmpxchg(word, (u32)args->expected, (u32)args->value);
+  case PCD_ATOMIC_XCHG:
+    return xchg(word, (u32)args->value);
+  default:
+    do {
+      old = READ_ONCE(*word);
+    } while (cmpxchg(word, old, old + (u32)args->value) != old);
+    return old;
+  }
+}
+
+/*cmpxchg64 is the one 64 bit primitive 32 bit ARM provides as well*/
+static u64 pcd_atomic64(u64 *word, const struct pcd_atomic *args) {
+  u64 old, new;
+
+  if (args->op == PCD_ATOMIC_CAS) {
+    return cmpxchg64(word, args->expected, args->value);
+  }
+
+  do {
+    old = READ_ONCE(*word);
+    new = args->op == PCD_ATOMIC_XCHG ? args->value : old + args->value;
+  } while (cmpxchg64(word, old, new) != old);
+
+  return old;
+}
+
+/*lock free read-modify-write of an aligned word, the old value is stored in
+ * args->old. Punching waits for an RCU grace period before it frees a page,
+ * which keeps the page alive for the duration of the op*/
+int pcd_store_atomic(struct pcd_store *store, struct pcd_atomic *args) {
+  pgoff_t index = args->offset >> PAGE_SHIFT;
+  struct page *page;
+  u64 expected;
+  void *vaddr;
+
+  for (;;) {
+    rcu_read_lock();
+    page = READ_ONCE(store->pages[index]);
+    if (page) {
+      break;
+    }
+    rcu_read_unlock();
+
+    /*fill the hole outside the read side section, then look again since
+     * a punch can race with us*/
+    if (!pcd_store_get_page(store, index)) {
+      return -ENOMEM;
+    }
+  }
+
+  vaddr = kmap_local_page(page) + offset_in_page(args->offset);
+  if (args->width == sizeof(u32)) {
+    args->old = pcd_atomic32(vaddr, args);
+    expected = (u32)args->expected;
+  } else {
+    args->old = pcd_atomic64(vaddr, args);
+    expected = args->expected;
+  }
+  kunmap_local(vaddr);
+  rcu_read_unlock();
+
+  /*a failed compare-and-swap left the word alone*/
+  if ((args->op != PCD_ATOMIC_CAS) || (args->old == expected)) {
+    pcd_store_mark_dirty(store, index);
+  }
+
+  return 0;
+}
+
+/*bits handed out per round, a multiple of 64 on every arch*/
+#define PCD_DIRTY_CHUNK_BITS 1024
+
+/*move the dirty bitmap to user space as __u64 words and clear it. Each word
+ * is taken with xchg, a page dirtied meanwhile is reported now or next time,
+ * never lost*/
+int pcd_store_dirty_fetch(struct pcd_store *store, u64 __user *ubitmap,
+                          u64 *epoch) {
+  unsigned long buf[BITS_TO_LONGS(PCD_DIRTY_CHUNK_BITS)];
+  u64 out[PCD_DIRTY_CHUNK_BITS / 64];
+  unsigned long bit, nbits, i, first;
+  bool fault = false;
+
+  for (bit = 0; bit < store->nr_pages; bit += PCD_DIRTY_CHUNK_BITS) {
+    nbits = min_t(unsigned long, PCD_DIRTY_CHUNK_BITS,
+                  store->nr_pages - bit);
+    first = BIT_WORD(bit);
+
+    for (i = 0; i < BITS_TO_LONGS(nbits); i++) {
+      buf[i] = xchg(&store->dirty[first + i], 0);
+    }
+
+    bitmap_to_arr64(out, buf, nbits);
+    if (!fault &&
+        copy_to_user(ubitmap + bit / 64, out, BITS_TO_U64(nbits) * 8)) {
+      fault = true;
+    }
+
+    /*give back what user space never got*/
+    if (fault) {
+      for_each_set_bit(i, buf, nbits) {
+        set_bit(bit + i, store->dirty);
+      }
+    }
+  }
+
+  if (fault) {
+    return -EFAULT;
+  }
+
+  *epoch = atomic64_inc_return(&store->dirty_epoch);
+  return 0;
+}
+
+/*allocate every hole and hand out the pages with a reference each, for
+ * dma-buf export. Punching stops until pcd_store_unpin_pages*/
+int pcd_store_pin_pages(struct pcd_store *store, struct page **pages) {
+  unsigned long i;
+
+  for (i = 0; i < store->nr_pages; i++) {
+    pages[i] = pcd_store_get_page(store, i);
+    if (!pages[i]) {
+      goto unpin;
+    }
+    get_page(pages[i]);
+  }
+  atomic_inc(&store->exports);
+
+  return 0;
+
+unpin:
+  while (i--) {
+    put_page(pages[i]);
+  }
+  return -ENOMEM;
+}
+
+void pcd_store_unpin_pages(struct pcd_store *store, struct page **pages) {
+  unsigned long i;
+
+  for (i = 0; i < store->nr_pages; i++) {
+    put_page(pages[i]);
+  }
+  atomic_dec(&store->exports);
+}
+
+/*feed len bytes at pos to fn one page at a time, holes as zeros*/
+int pcd_store_walk(struct pcd_store *store, loff_t pos, size_t len,
+                   int (*fn)(void *ctx, const void *data, size_t len),
+                   void *ctx) {
+  const void *zero = page_address(ZERO_PAGE(0));
+  size_t offset, chunk;
+  struct page *page;
+  void *vaddr;
+  int ret;
+
+  while (len) {
+    offset = offset_in_page(pos);
+    chunk = min_t(size_t, PAGE_SIZE - offset, len);
+
+    page = READ_ONCE(store->pages[pos >> PAGE_SHIFT]);
+    if (page) {
+      vaddr = kmap_local_page(page);
+      ret = fn(ctx, vaddr + offset, chunk);
+      kunmap_local(vaddr);
+    } else {
+      ret = fn(ctx, zero, chunk);
+    }
+    if (ret) {
+      return ret;
+    }
+
+    pos += chunk;
+    len -= chunk;
+  }
+
+  return 0;
+}
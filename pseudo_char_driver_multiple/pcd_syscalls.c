@@ -0,0 +1,597 @@
+#include <linux/dma-buf.h>
+#include <linux/falloc.h>
+#include <linux/file.h>
+#include <linux/slab.h>
+#include <linux/uio.h>
+
+#include "pcd_m.h"
+
+/*tell pollers and SIGIO owners that the device contents changed*/
+void pcd_notify(struct pcdev_private_data *pcdev_data) {
+  atomic64_inc(&pcdev_data->write_gen);
+  if (wq_has_sleeper(&pcdev_data->wq)) {
+    wake_up_interruptible_poll(&pcdev_data->wq, EPOLLIN | EPOLLRDNORM);
+  }
+  kill_fasync(&pcdev_data->fasync, SIGIO, POLL_IN);
+}
+
+/*iter over the user buffer of read() or write(), iov backs it on kernels
+ * without iov_iter_ubuf*/
+static void pcd_user_iter(struct iov_iter *iter, struct iovec *iov,
+                          unsigned int dir, void __user *buff, size_t count) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+  iov_iter_ubuf(iter, dir, buff, count);
+#else
+  iov->iov_base = buff;
+  iov->iov_len = count;
+  iov_iter_init(iter, dir, iov, 1, count);
+#endif
+}
+
+loff_t pcd_llseek(struct file *filep, loff_t offset, int whence) {
+  struct pcd_file *pfile = filep->private_data;
+  struct pcdev_private_data *pcdev_data = pfile->pcdev_data;
+
+  /*logs and rings have no positions, reads and writes go to their ends*/
+  if (pcdev_data->mode != PCD_MODE_BUFFER) {
+    return -ESPIPE;
+  }
+
+  return pcd_core_llseek(filep, offset, whence, pcdev_data->size);
+}
+
+ssize_t pcd_read(struct file *filep, char __user *buff, size_t count,
+                 loff_t *f_pos) {
+  struct pcd_file *pfile = filep->private_data;
+  struct pcdev_private_data *pcdev_data = pfile->pcdev_data;
+  loff_t max_size = pcdev_data->size;
+  struct iov_iter iter;
+  struct iovec iov;
+  ssize_t ret;
+
+  if (pcdev_data->mode == PCD_MODE_LOG) {
+    return pcd_log_read(pcdev_data, filep, buff, count);
+  }
+  if (pcdev_data->mode == PCD_MODE_RING) {
+    return pcd_ring_read(pcdev_data, pfile, filep, buff, count);
+  }
+
+  /* Adjust the count */
+  count = pcd_core_clamp(*f_pos, count, max_size);
+
+  /*changes from here on will wake the reader again*/
+  pfile->seen_gen = atomic64_read(&pcdev_data->write_gen);
+
+  /*copy to user */
+  pcd_range_lock(&pcdev_data->rlock, *f_pos, count, false, 0);
+  pcd_user_iter(&iter, &iov, ITER_DEST, buff, count);
+  ret = pcd_store_read(&pcdev_data->store, &iter, *f_pos);
+  pcd_range_unlock(&pcdev_data->rlock, *f_pos, count, false);
+  if (ret < 0) {
+    return ret;
+  }
+
+  /*update the current file position*/
+  *f_pos += ret;
+
+  /*Return the number of bytes which have been successfully read*/
+  return ret;
+}
+
+ssize_t pcd_write(struct file *filep, const char __user *buff, size_t count,
+                  loff_t *f_pos) {
+  struct pcd_file *pfile = filep->private_data;
+  struct pcdev_private_data *pcdev_data = pfile->pcdev_data;
+  loff_t max_size = pcdev_data->size;
+  struct iov_iter iter;
+  struct iovec iov;
+  ssize_t ret;
+
+  if (pcdev_data->mode == PCD_MODE_LOG) {
+    return pcd_log_write(pcdev_data, buff, count);
+  }
+  if (pcdev_data->mode == PCD_MODE_RING) {
+    return pcd_ring_write(pcdev_data, buff, count);
+  }
+
+  /* Adjust the count */
+  ret = pcd_core_write_count(*f_pos, count, max_size);
+  if (ret <= 0) {
+    return ret;
+  }
+  count = ret;
+
+  /*copy from user */
+  pcd_range_lock(&pcdev_data->rlock, *f_pos, count, true, 0);
+  pcd_user_iter(&iter, &iov, ITER_SOURCE, (void __user *)buff, count);
+  ret = pcd_store_write(&pcdev_data->store, &iter, *f_pos);
+  pcd_range_unlock(&pcdev_data->rlock, *f_pos, count, true);
+  if (ret < 0) {
+    return ret;
+  }
+  pcd_notify(pcdev_data);
+
+  /*update the current file position*/
+  *f_pos += ret;
+
+  /*Return the number of bytes which have been successfully written*/
+  return ret;
+}
+
+/*device to device copy inside the kernel, no user buffer in between,
+ * holes in the source stay holes in the destination*/
+static long pcd_copy_range(struct file *filep,
+                           struct pcd_copy_range __user *uarg) {
+  struct pcd_file *pfile = filep->private_data;
+  struct pcdev_private_data *dst = pfile->pcdev_data;
+  struct pcdev_private_data *src, *first, *second;
+  struct pcd_copy_range args;
+  struct file *src_file;
+  u64 start, span;
+  long ret;
+
+  if (copy_from_user(&args, uarg, sizeof(args))) {
+    return -EFAULT;
+  }
+
+  /*device permissions were enforced at open time through f_mode*/
+  if (!(filep->f_mode & FMODE_WRITE)) {
+    return -EBADF;
+  }
+
+  src_file = fget(args.src_fd);
+  if (!src_file) {
+    return -EBADF;
+  }
+
+  if (src_file->f_op != &pcd_fops) {
+    ret = -EINVAL;
+    goto out;
+  }
+  if (!(src_file->f_mode & FMODE_READ)) {
+    ret = -EBADF;
+    goto out;
+  }
+  pfile = src_file->private_data;
+  src = pfile->pcdev_data;
+  if (src->mode != PCD_MODE_BUFFER) {
+    ret = -EINVAL;
+    goto out;
+  }
+
+  if ((args.src_offset > src->size) || (args.dst_offset > dst->size)) {
+    ret = -EINVAL;
+    goto out;
+  }
+
+  /*clamp the copy to both devices*/
+  args.len = min3(args.len, (u64)src->size - args.src_offset,
+                  (u64)dst->size - args.dst_offset);
+
+  /*lock two devices in address order so crossing copies cannot deadlock*/
+  if (src == dst) {
+    /*one exclusive range covering both sides*/
+    start = min(args.src_offset, args.dst_offset);
+    span = max(args.src_offset, args.dst_offset) + args.len - start;
+    pcd_range_lock(&dst->rlock, start, span, true, 0);
+    ret = pcd_store_copy(&dst->store, args.dst_offset, &src->store,
+                         args.src_offset, args.len);
+    pcd_range_unlock(&dst->rlock, start, span, true);
+  } else {
+    first = src < dst ? src : dst;
+    second = src < dst ? dst : src;
+    pcd_range_lock(&first->rlock,
+                   first == src ? args.src_offset : args.dst_offset,
+                   args.len, first == dst, 0);
+    pcd_range_lock(&second->rlock,
+                   second == src ? args.src_offset : args.dst_offset,
+                   args.len, second == dst, SINGLE_DEPTH_NESTING);
+    ret = pcd_store_copy(&dst->store, args.dst_offset, &src->store,
+                         args.src_offset, args.len);
+    pcd_range_unlock(&dst->rlock, args.dst_offset, args.len, true);
+    pcd_range_unlock(&src->rlock, args.src_offset, args.len, false);
+  }
+
+  if (!ret) {
+    ret = args.len;
+    pcd_notify(dst);
+  }
+out:
+  fput(src_file);
+  return ret;
+}
+
+/*clear a range at memset speed, punching frees the pages it fully covers*/
+static long pcd_fallocate(struct file *filep,
+                          struct pcd_fallocate __user *uarg) {
+  struct pcd_file *pfile = filep->private_data;
+  struct pcdev_private_data *pcdev_data = pfile->pcdev_data;
+  struct pcd_fallocate args;
+  bool punch;
+
+  if (copy_from_user(&args, uarg, sizeof(args))) {
+    return -EFAULT;
+  }
+
+  /*the device size is fixed, so FALLOC_FL_KEEP_SIZE is implied*/
+  switch (args.mode & ~FALLOC_FL_KEEP_SIZE) {
+  case FALLOC_FL_PUNCH_HOLE:
+    punch = true;
+    break;
+  case FALLOC_FL_ZERO_RANGE:
+    punch = false;
+    break;
+  default:
+    return -EOPNOTSUPP;
+  }
+
+  if (!(filep->f_mode & FMODE_WRITE)) {
+    return -EBADF;
+  }
+
+  if (args.offset > pcdev_data->size) {
+    return -EINVAL;
+  }
+  args.len = min_t(u64, args.len, pcdev_data->size - args.offset);
+
+  pcd_range_lock(&pcdev_data->rlock, args.offset, args.len, true, 0);
+  pcd_store_zero(&pcdev_data->store, args.offset, args.len, punch);
+  pcd_range_unlock(&pcdev_data->rlock, args.offset, args.len, true);
+  pcd_notify(pcdev_data);
+
+  return 0;
+}
+
+/*one syscall read-modify-write of a device word, no device lock taken*/
+static long pcd_atomic(struct file *filep, struct pcd_atomic __user *uarg) {
+  struct pcd_file *pfile = filep->private_data;
+  struct pcdev_private_data *pcdev_data = pfile->pcdev_data;
+  u64 expected;
+  struct pcd_atomic args;
+  int ret;
+
+  if (copy_from_user(&args, uarg, sizeof(args))) {
+    return -EFAULT;
+  }
+
+  if (args.op > PCD_ATOMIC_XCHG) {
+    return -EINVAL;
+  }
+  if ((args.width != sizeof(u32)) && (args.width != sizeof(u64))) {
+    return -EINVAL;
+  }
+
+  /*the old value is handed back, so the op needs both read and write*/
+  if ((filep->f_mode & (FMODE_READ | FMODE_WRITE)) !=
+      (FMODE_READ | FMODE_WRITE)) {
+    return -EBADF;
+  }
+
+  /*aligned words never straddle a page*/
+  if (!IS_ALIGNED(args.offset, args.width) ||
+      (args.offset >= pcdev_data->size) ||
+      (pcdev_data->size - args.offset < args.width)) {
+    return -EINVAL;
+  }
+
+  ret = pcd_store_atomic(&pcdev_data->store, &args);
+  if (ret) {
+    return ret;
+  }
+
+  /*a failed compare-and-swap left the word alone*/
+  expected = args.width == sizeof(u32) ? (u32)args.expected : args.expected;
+  if ((args.op != PCD_ATOMIC_CAS) || (args.old == expected)) {
+    pcd_notify(pcdev_data);
+  }
+
+  if (put_user(args.old, &uarg->old)) {
+    return -EFAULT;
+  }
+
+  return 0;
+}
+
+/*incremental sync, hand out and reset the dirty page bitmap*/
+static long pcd_dirty(struct file *filep, struct pcd_dirty __user *uarg) {
+  struct pcd_file *pfile = filep->private_data;
+  struct pcd_store *store = &pfile->pcdev_data->store;
+  struct pcd_dirty args;
+  int ret;
+
+  if (copy_from_user(&args, uarg, sizeof(args))) {
+    return -EFAULT;
+  }
+
+  if (!(filep->f_mode & FMODE_READ)) {
+    return -EBADF;
+  }
+
+  if (put_user((u64)store->nr_pages, &uarg->nr_pages)) {
+    return -EFAULT;
+  }
+  if (args.size < BITS_TO_U64(store->nr_pages) * sizeof(u64)) {
+    return -ENOSPC;
+  }
+
+  ret = pcd_store_dirty_fetch(store, u64_to_user_ptr(args.bitmap),
+                              &args.epoch);
+  if (ret) {
+    return ret;
+  }
+
+  if (put_user(args.epoch, &uarg->epoch)) {
+    return -EFAULT;
+  }
+
+  return 0;
+}
+
+static long pcd_export(struct file *filep, struct pcd_dmabuf __user *uarg) {
+  struct pcd_file *pfile = filep->private_data;
+  struct pcd_dmabuf args;
+  struct dma_buf *dmabuf;
+  int fd;
+
+  if (copy_from_user(&args, uarg, sizeof(args))) {
+    return -EFAULT;
+  }
+
+  if (args.flags & ~O_CLOEXEC) {
+    return -EINVAL;
+  }
+
+  /*importers can map the buffer writable*/
+  if ((filep->f_mode & (FMODE_READ | FMODE_WRITE)) !=
+      (FMODE_READ | FMODE_WRITE)) {
+    return -EBADF;
+  }
+
+  dmabuf = pcd_dmabuf_export(pfile->pcdev_data);
+  if (IS_ERR(dmabuf)) {
+    return PTR_ERR(dmabuf);
+  }
+
+  fd = get_unused_fd_flags(args.flags);
+  if (fd < 0) {
+    dma_buf_put(dmabuf);
+    return fd;
+  }
+
+  /*only publish the fd once user space got its number*/
+  if (put_user(fd, &uarg->fd)) {
+    put_unused_fd(fd);
+    dma_buf_put(dmabuf);
+    return -EFAULT;
+  }
+  fd_install(fd, dmabuf->file);
+
+  return 0;
+}
+
+static long pcd_checksum(struct file *filep,
+                         struct pcd_checksum __user *uarg) {
+  struct pcd_file *pfile = filep->private_data;
+  struct pcdev_private_data *pcdev_data = pfile->pcdev_data;
+  struct pcd_checksum args;
+  bool cache;
+  int ret;
+
+  if (copy_from_user(&args, uarg, sizeof(args))) {
+    return -EFAULT;
+  }
+
+  if (args.algo > PCD_CSUM_XXH64 || (args.flags & ~PCD_CSUM_PAGES)) {
+    return -EINVAL;
+  }
+  if ((args.flags & PCD_CSUM_PAGES) &&
+      ((args.algo != PCD_CSUM_CRC32C) || !PAGE_ALIGNED(args.offset))) {
+    return -EINVAL;
+  }
+
+  if (!(filep->f_mode & FMODE_READ)) {
+    return -EBADF;
+  }
+
+  if (args.offset > pcdev_data->size) {
+    return -EINVAL;
+  }
+  args.len = min_t(u64, args.len, pcdev_data->size - args.offset);
+
+  /*filling the page checksum cache writes to it*/
+  cache = args.flags & PCD_CSUM_PAGES;
+  pcd_range_lock(&pcdev_data->rlock, args.offset, args.len, cache, 0);
+  ret = pcd_store_checksum(&pcdev_data->store, &args);
+  pcd_range_unlock(&pcdev_data->rlock, args.offset, args.len, cache);
+  if (ret) {
+    return ret;
+  }
+
+  if (put_user(args.csum, &uarg->csum)) {
+    return -EFAULT;
+  }
+
+  return 0;
+}
+
+/*most offsets handed back by one search call*/
+#define PCD_SEARCH_MAX_MATCHES 4096
+
+static long pcd_search(struct file *filep, struct pcd_search __user *uarg) {
+  struct pcd_file *pfile = filep->private_data;
+  struct pcdev_private_data *pcdev_data = pfile->pcdev_data;
+  u8 pattern[PCD_SEARCH_MAX_PATTERN];
+  struct pcd_search args;
+  u64 *matches, span;
+  long ret = 0;
+
+  if (copy_from_user(&args, uarg, sizeof(args))) {
+    return -EFAULT;
+  }
+
+  if (!args.pattern_len || (args.pattern_len > PCD_SEARCH_MAX_PATTERN) ||
+      !args.max_matches) {
+    return -EINVAL;
+  }
+  args.max_matches = min_t(u32, args.max_matches, PCD_SEARCH_MAX_MATCHES);
+
+  if (!(filep->f_mode & FMODE_READ)) {
+    return -EBADF;
+  }
+
+  if (args.offset > pcdev_data->size) {
+    return -EINVAL;
+  }
+  args.limit = min_t(u64, args.limit, pcdev_data->size - args.offset);
+
+  if (copy_from_user(pattern, u64_to_user_ptr(args.pattern),
+                     args.pattern_len)) {
+    return -EFAULT;
+  }
+
+  matches = kvmalloc_array(args.max_matches, sizeof(*matches), GFP_KERNEL);
+  if (!matches) {
+    return -ENOMEM;
+  }
+
+  /*a pattern longer than the device can't match*/
+  args.nr_matches = 0;
+  args.next = args.offset + args.limit;
+  if (args.pattern_len <= pcdev_data->size) {
+    /*matches starting in the range may extend past it*/
+    span = min_t(u64, args.limit + args.pattern_len - 1,
+                 pcdev_data->size - args.offset);
+    pcd_range_lock(&pcdev_data->rlock, args.offset, span, false, 0);
+    pcd_store_search(&pcdev_data->store, &args, pattern, matches);
+    pcd_range_unlock(&pcdev_data->rlock, args.offset, span, false);
+  }
+
+  if (copy_to_user(u64_to_user_ptr(args.matches), matches,
+                   args.nr_matches * sizeof(*matches)) ||
+      put_user(args.nr_matches, &uarg->nr_matches) ||
+      put_user(args.next, &uarg->next)) {
+    ret = -EFAULT;
+  }
+
+  kvfree(matches);
+  return ret;
+}
+
+long pcd_ioctl(struct file *filep, unsigned int cmd, unsigned long arg) {
+  struct pcd_file *pfile = filep->private_data;
+
+  /*every ioctl works on the page store*/
+  if (pfile->pcdev_data->mode != PCD_MODE_BUFFER) {
+    return -ENOTTY;
+  }
+
+  switch (cmd) {
+  case PCD_IOC_COPY_RANGE:
+    return pcd_copy_range(filep, (struct pcd_copy_range __user *)arg);
+  case PCD_IOC_FALLOCATE:
+    return pcd_fallocate(filep, (struct pcd_fallocate __user *)arg);
+  case PCD_IOC_ATOMIC:
+    return pcd_atomic(filep, (struct pcd_atomic __user *)arg);
+  case PCD_IOC_DIRTY:
+    return pcd_dirty(filep, (struct pcd_dirty __user *)arg);
+  case PCD_IOC_EXPORT_DMABUF:
+    return pcd_export(filep, (struct pcd_dmabuf __user *)arg);
+  case PCD_IOC_CHECKSUM:
+    return pcd_checksum(filep, (struct pcd_checksum __user *)arg);
+  case PCD_IOC_SEARCH:
+    return pcd_search(filep, (struct pcd_search __user *)arg);
+  default:
+    return -ENOTTY;
+  }
+}
+
+int pcd_open(struct inode *inode, struct file *filep) {
+  int ret, minor_n;
+  struct pcdev_private_data *pcdev_data;
+  struct pcd_file *pfile;
+  /*find out on which device file open was attempted by the user space*/
+  minor_n = MINOR(inode->i_rdev);
+  pr_info("minor access = %d\n", minor_n);
+
+  /*get device's private data structure*/
+  pcdev_data = container_of(inode->i_cdev, struct pcdev_private_data, cdev);
+
+  /*check permission*/
+  ret = pcd_core_check_permission(pcdev_data->perm, filep->f_mode);
+
+  if (!ret) {
+    pfile = kzalloc(sizeof(*pfile), GFP_KERNEL);
+    if (!pfile) {
+      return -ENOMEM;
+    }
+    pfile->pcdev_data = pcdev_data;
+    pfile->seen_gen = atomic64_read(&pcdev_data->write_gen);
+    if (pcdev_data->mode == PCD_MODE_RING) {
+      ret = pcd_ring_open(pcdev_data, pfile, filep);
+      if (ret) {
+        kfree(pfile);
+        return ret;
+      }
+    }
+    /*to supply device private data to other methods of the driver*/
+    filep->private_data = pfile;
+  }
+
+  (!ret) ? pr_info("open was successfull\n")
+         : pr_info("open was unsuccessful\n");
+
+  return ret;
+}
+
+int pcd_release(struct inode *inode, struct file *filep) {
+  struct pcd_file *pfile = filep->private_data;
+
+  pcd_fasync(-1, filep, 0);
+  if (pfile->pcdev_data->mode == PCD_MODE_RING) {
+    pcd_ring_release(pfile->pcdev_data, filep);
+  }
+  kfree(pfile);
+  pr_info("release was successful\n");
+  return 0;
+}
+
+/*readable once the contents changed since this file last read them*/
+__poll_t pcd_poll(struct file *filep, struct poll_table_struct *wait) {
+  struct pcd_file *pfile = filep->private_data;
+  struct pcdev_private_data *pcdev_data = pfile->pcdev_data;
+  __poll_t mask = 0;
+
+  poll_wait(filep, &pcdev_data->wq, wait);
+
+  if ((filep->f_mode & FMODE_READ) && (pcdev_data->mode == PCD_MODE_LOG)) {
+    mask |= pcd_log_poll(pcdev_data);
+  } else if ((filep->f_mode & FMODE_READ) &&
+             (pcdev_data->mode == PCD_MODE_RING)) {
+    mask |= pcd_ring_poll(pcdev_data, pfile);
+  } else if ((filep->f_mode & FMODE_READ) &&
+             (atomic64_read(&pcdev_data->write_gen) != pfile->seen_gen)) {
+    mask |= EPOLLIN | EPOLLRDNORM;
+  }
+  if (filep->f_mode & FMODE_WRITE) {
+    mask |= EPOLLOUT | EPOLLWRNORM;
+  }
+
+  return mask;
+}
+
+int pcd_fasync(int fd, struct file *filep, int on) {
+  struct pcd_file *pfile = filep->private_data;
+
+  return fasync_helper(fd, filep, on, &pfile->pcdev_data->fasync);
+}
+
+/*only log mode devices can be mapped, one CPU's ring per mapping*/
+int pcd_mmap(struct file *filep, struct vm_area_struct *vma) {
+  struct pcd_file *pfile = filep->private_data;
+
+  if (pfile->pcdev_data->mode != PCD_MODE_LOG) {
+    return -ENODEV;
+  }
+
+  return pcd_log_mmap(&pfile->pcdev_data->log, vma);
+}